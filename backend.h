@@ -0,0 +1,447 @@
+#ifndef QUICKSAMPLER_BACKEND_H
+#define QUICKSAMPLER_BACKEND_H
+
+#include <limits.h>
+#include <z3++.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cdcl.h"
+#include "clausedb.h"
+#include "dimacs.h"
+#include "localsearch.h"
+#include "profiler.h"
+#include "sample.h"
+#include "vartable.h"
+
+// The solver behind one sampling thread. A backend answers two kinds of
+// queries over the independent support: a model close to an arbitrary
+// target assignment, and, once set_base() has fixed the epoch's base model,
+// a model close to the base in which variable i takes the opposite value.
+// How close is up to the backend.
+class Backend {
+public:
+    enum Result { SAT, UNSAT, UNKNOWN };
+
+    virtual ~Backend() {}
+    virtual void load(const Formula & f) = 0;
+    virtual Result solve(const Sample & target, Sample & out) = 0;
+    virtual void set_base(const Sample & base) = 0;
+    virtual Result flip(size_t i, Sample & out) = 0;
+    virtual void clear_base() = 0;
+    // May be called from another thread; the running query returns UNKNOWN
+    // or throws z3::exception.
+    virtual void interrupt() = 0;
+    // Every later query gives up with UNKNOWN after that many seconds; 0 for
+    // no limit.
+    virtual void set_time_limit(double seconds) = 0;
+    // Whether the last query was answered without the solver.
+    virtual bool answered_locally() const {
+        return false;
+    }
+
+    static bool exists(const std::string & kind) {
+        return kind == "optimize" || kind == "solver" || kind == "cdcl";
+    }
+
+    static Backend * create(const std::string & kind, unsigned seed);
+
+    // Where the time spent reading models goes; may be null.
+    void set_profile(Profile * p) {
+        profile = p;
+    }
+
+protected:
+    Profile * profile = nullptr;
+    // The limit in milliseconds last passed to z3; 0 for none.
+    unsigned limit_ms = 0;
+
+    // Sets z3's timeout parameter, unless it is unchanged.
+    template <typename Solver>
+    void set_timeout(z3::context & c, Solver & s, double seconds) {
+        unsigned ms = seconds > 0 ? (unsigned)std::min(seconds * 1000.0 + 1.0, 4.0e9) : 0;
+        if (ms == limit_ms)
+            return;
+        limit_ms = ms;
+        z3::params p(c);
+        p.set("timeout", ms > 0 ? ms : UINT_MAX);
+        s.set(p);
+    }
+};
+
+// Adds the clauses of f to a z3 solver or optimizer in batches, built with
+// the C API straight from the literal table.
+template <typename Solver>
+void add_clauses(z3::context & c, const VarTable & vars, const Formula & f, Solver & s) {
+    const size_t batch_size = 4096;
+    z3::expr_vector batch(c);
+    std::vector<Z3_ast> args;
+    for (size_t k = 0; k < f.num_clauses(); ++k) {
+        args.clear();
+        for (const int * l = f.clause_begin(k); l != f.clause_end(k); ++l)
+            args.push_back(vars.dimacs(*l));
+        if (args.size() == 1)
+            batch.push_back(z3::expr(c, args[0]));
+        else
+            batch.push_back(z3::expr(c, Z3_mk_or(c, args.size(), args.data())));
+        if (batch.size() == batch_size) {
+            s.add(mk_and(batch));
+            batch = z3::expr_vector(c);
+        }
+    }
+    if (batch.size() > 0)
+        s.add(mk_and(batch));
+}
+
+inline Backend::Result to_result(z3::check_result r) {
+    return r == z3::sat ? Backend::SAT : r == z3::unsat ? Backend::UNSAT : Backend::UNKNOWN;
+}
+
+// MaxSAT through z3::optimize, with one soft constraint per independent
+// variable. Flipped models are as close to the base as possible.
+class OptimizeBackend : public Backend {
+    z3::context c;
+    z3::optimize opt;
+    VarTable vars;
+    Sample base;
+
+public:
+    // z3's optimizer takes no random seed.
+    OptimizeBackend(unsigned) : opt(c), vars(c) {}
+
+    void load(const Formula & f) {
+        vars.init(f.max_var, f.ind);
+        add_clauses(c, vars, f, opt);
+    }
+
+    Result solve(const Sample & target, Sample & out) {
+        opt.push();
+        prefer(target);
+        Result r = to_result(opt.check());
+        if (r == SAT) {
+            PhaseTimer t(profile, Profile::EXTRACT);
+            vars.extract(opt.get_model(), out);
+        }
+        opt.pop();
+        return r;
+    }
+
+    void set_base(const Sample & b) {
+        base = b;
+        opt.push();
+        prefer(base);
+    }
+
+    Result flip(size_t i, Sample & out) {
+        opt.push();
+        opt.add(vars.ind_lit(i, !base.get(i)));
+        Result r = to_result(opt.check());
+        if (r == SAT) {
+            PhaseTimer t(profile, Profile::EXTRACT);
+            vars.extract(opt.get_model(), out);
+        }
+        opt.pop();
+        return r;
+    }
+
+    void clear_base() {
+        opt.pop();
+    }
+
+    void interrupt() {
+        c.interrupt();
+    }
+
+    void set_time_limit(double seconds) {
+        set_timeout(c, opt, seconds);
+    }
+
+private:
+    void prefer(const Sample & s) {
+        for (size_t i = 0; i < s.size(); ++i)
+            opt.add(vars.ind_lit(i, s.get(i)), 1);
+    }
+};
+
+// Plain z3::solver over the SAT core with randomized phases. Closeness comes
+// from assuming the target value of every independent variable and dropping
+// the assumptions in each unsat core until the query is satisfiable.
+class AssumptionBackend : public Backend {
+    z3::context c;
+    z3::solver s;
+    VarTable vars;
+    std::unordered_map<unsigned, size_t> index_of;
+    Sample base;
+    // After this many cores the remaining soft assumptions are all dropped.
+    const int max_rounds = 16;
+
+public:
+    AssumptionBackend(unsigned seed) : s(c, "QF_FD"), vars(c) {
+        z3::params p(c);
+        p.set("random_seed", seed);
+        p.set("phase", "random");
+        s.set(p);
+    }
+
+    void load(const Formula & f) {
+        vars.init(f.max_var, f.ind);
+        for (size_t i = 0; i < f.ind.size(); ++i) {
+            index_of[Z3_get_ast_id(c, vars.ind_lit(i, true))] = i;
+            index_of[Z3_get_ast_id(c, vars.ind_lit(i, false))] = i;
+        }
+        add_clauses(c, vars, f, s);
+    }
+
+    Result solve(const Sample & target, Sample & out) {
+        return closest(target, -1, out);
+    }
+
+    void set_base(const Sample & b) {
+        base = b;
+    }
+
+    Result flip(size_t i, Sample & out) {
+        return closest(base, i, out);
+    }
+
+    void clear_base() {
+    }
+
+    void interrupt() {
+        c.interrupt();
+    }
+
+    void set_time_limit(double seconds) {
+        set_timeout(c, s, seconds);
+    }
+
+private:
+    Result closest(const Sample & target, long hard, Sample & out) {
+        std::vector<char> dropped(target.size(), 0);
+        for (int round = 0; ; ++round) {
+            z3::expr_vector asms(c);
+            if (hard >= 0)
+                asms.push_back(vars.ind_lit(hard, !target.get(hard)));
+            if (round < max_rounds)
+                for (size_t i = 0; i < target.size(); ++i)
+                    if ((long)i != hard && !dropped[i])
+                        asms.push_back(vars.ind_lit(i, target.get(i)));
+            Result r = to_result(s.check(asms));
+            if (r == SAT) {
+                PhaseTimer t(profile, Profile::EXTRACT);
+                vars.extract(s.get_model(), out);
+            }
+            if (r != UNSAT || round >= max_rounds)
+                return r;
+            z3::expr_vector core = s.unsat_core();
+            bool progress = false;
+            for (unsigned k = 0; k < core.size(); ++k) {
+                auto it = index_of.find(Z3_get_ast_id(c, core[k]));
+                if (it != index_of.end() && (long)it->second != hard) {
+                    dropped[it->second] = 1;
+                    progress = true;
+                }
+            }
+            if (!progress)
+                return UNSAT;
+        }
+    }
+};
+
+// The in-process CDCL solver. The saved phases of the independent variables
+// are reset to the target before every query, so the search starts from it.
+class CdclBackend : public Backend {
+    Cdcl solver;
+    std::vector<int> ind;
+    Sample base;
+
+public:
+    CdclBackend(unsigned seed) : solver(seed) {}
+
+    void load(const Formula & f) {
+        ind = f.ind;
+        int nvars = f.max_var;
+        for (int v : ind)
+            if (v > nvars)
+                nvars = v;
+        solver.reserve_vars(nvars);
+        for (size_t k = 0; k < f.num_clauses(); ++k)
+            solver.add_clause(f.clause_begin(k), f.clause_end(k));
+    }
+
+    Result solve(const Sample & target, Sample & out) {
+        steer(target);
+        return query(std::vector<int>(), out);
+    }
+
+    void set_base(const Sample & b) {
+        base = b;
+    }
+
+    Result flip(size_t i, Sample & out) {
+        if (ind[i] <= 0)
+            return UNSAT;
+        steer(base);
+        std::vector<int> assume(1, base.get(i) ? -ind[i] : ind[i]);
+        return query(assume, out);
+    }
+
+    void clear_base() {
+    }
+
+    void interrupt() {
+        solver.interrupt();
+    }
+
+    void set_time_limit(double seconds) {
+        solver.set_time_limit(seconds);
+    }
+
+private:
+    void steer(const Sample & target) {
+        for (size_t i = 0; i < ind.size(); ++i)
+            if (ind[i] > 0)
+                solver.set_phase(ind[i], target.get(i));
+    }
+
+    Result query(const std::vector<int> & assume, Sample & out) {
+        Cdcl::Result r = solver.solve(assume);
+        if (r == Cdcl::SAT) {
+            PhaseTimer t(profile, Profile::EXTRACT);
+            out = Sample(ind.size());
+            for (size_t i = 0; i < ind.size(); ++i)
+                if (solver.model_value(ind[i]))
+                    out.set(i, true);
+            return SAT;
+        }
+        return r == Cdcl::UNSAT ? UNSAT : UNKNOWN;
+    }
+};
+
+// Answers flips by local search when it repairs the base model within
+// max_steps steps, and passes them to another backend otherwise. The
+// flipped variable is frozen at its new value, and the search starts from a
+// model of the whole formula that projects to the base, which is restored
+// afterwards. That model is searched for once per epoch with the support
+// frozen, starting from the last one, with as many steps as all the flips
+// together; when that fails, the epoch's flips all go to the other backend.
+// Initial models always come from the other backend: local search from a
+// random target finds some models far more often than others.
+class LocalSearchBackend : public Backend {
+    std::unique_ptr<Backend> inner;
+    unsigned seed;
+    size_t max_steps;
+    SearchStats * stats;
+    std::unique_ptr<ClauseDB> db;
+    std::unique_ptr<LocalSearch> search;
+    // Whether the assignment of search satisfies the formula, and whether
+    // it projects to the base.
+    bool model = false;
+    bool at_base = false;
+    bool local = false;
+    Sample base;
+
+public:
+    LocalSearchBackend(Backend * inner, unsigned seed, size_t max_steps, SearchStats * stats) : inner(inner), seed(seed), max_steps(max_steps), stats(stats) {}
+
+    void load(const Formula & f) {
+        inner->load(f);
+        db.reset(new ClauseDB(f));
+        search.reset(new LocalSearch(*db, seed));
+    }
+
+    Result solve(const Sample & target, Sample & out) {
+        local = false;
+        return inner->solve(target, out);
+    }
+
+    void set_base(const Sample & b) {
+        inner->set_base(b);
+        base = b;
+        Sample current;
+        if (model)
+            search->project(current);
+        at_base = model && current == b;
+        if (at_base || db->has_empty)
+            return;
+        // Counted as search time, but not as an attempt.
+        uint64_t start = Profile::ticks();
+        freeze_support(true);
+        search->mark();
+        search->assign(b);
+        at_base = model = search->walk(max_steps * (db->ind.size() + 1));
+        freeze_support(false);
+        uint64_t ticks = Profile::ticks() - start;
+        stats->search_ticks += ticks;
+        if (profile)
+            profile->record(Profile::SEARCH, ticks);
+    }
+
+    Result flip(size_t i, Sample & out) {
+        int v = db->ind[i];
+        if (at_base && v > 0) {
+            uint64_t start = Profile::ticks();
+            search->mark();
+            search->set(v, !base.get(i));
+            search->freeze(v, true);
+            bool found = search->walk(max_steps);
+            if (found)
+                search->project(out);
+            search->freeze(v, false);
+            search->undo();
+            uint64_t end = Profile::ticks();
+            stats->attempts += 1;
+            if (found)
+                stats->hits += 1;
+            stats->search_ticks += end - start;
+            if (profile)
+                profile->record(Profile::SEARCH, end - start);
+            local = found;
+            if (found)
+                return SAT;
+        }
+        local = false;
+        uint64_t start = Profile::ticks();
+        Result r = inner->flip(i, out);
+        stats->calls += 1;
+        stats->solver_ticks += Profile::ticks() - start;
+        return r;
+    }
+
+    void clear_base() {
+        inner->clear_base();
+        at_base = false;
+    }
+
+    void interrupt() {
+        inner->interrupt();
+    }
+
+    void set_time_limit(double seconds) {
+        inner->set_time_limit(seconds);
+    }
+
+    bool answered_locally() const {
+        return local;
+    }
+
+private:
+    void freeze_support(bool f) {
+        for (int v : db->ind)
+            if (v > 0)
+                search->freeze(v, f);
+    }
+};
+
+inline Backend * Backend::create(const std::string & kind, unsigned seed) {
+    if (kind == "solver")
+        return new AssumptionBackend(seed);
+    if (kind == "cdcl")
+        return new CdclBackend(seed);
+    return new OptimizeBackend(seed);
+}
+
+#endif
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <z3++.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dedup.h"
+#include "dimacs.h"
+#include "epoch.h"
+#include "sample.h"
+#include "vartable.h"
+#include "writer.h"
+
+// Micro-benchmarks of the sampler's hot kernels on synthetic inputs, with
+// no solver involved: parsing, reading models, combining samples, dedup and
+// output. Each kernel runs for a fixed number of operations at every size
+// of the independent support given on the command line.
+//
+// Usage: microbench [nvars...]     (default 1000 10000 100000)
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1.0e-9 * t.tv_nsec;
+}
+
+// Sums values that would otherwise be optimized away.
+static volatile uint64_t sink = 0;
+
+static void report(const char * kernel, size_t nvars, size_t ops, double seconds) {
+    printf("%-16s %8zu vars %10zu ops %12.1f ns/op %12.0f ops/s\n", kernel, nvars, ops, 1.0e9 * seconds / ops, ops / seconds);
+}
+
+static Sample random_sample(size_t n, std::mt19937_64 & rng) {
+    Sample s(n);
+    for (size_t i = 0; i < n; ++i)
+        if (rng() & 1)
+            s.set(i, true);
+    return s;
+}
+
+// A random 3-CNF over 4 * nvars variables with 4 clauses per variable,
+// whose first nvars variables are the independent support.
+static std::string synthetic_cnf(size_t nvars, std::mt19937_64 & rng) {
+    size_t total = 4 * nvars;
+    size_t nclauses = 4 * total;
+    std::string text = "p cnf " + std::to_string(total) + " " + std::to_string(nclauses) + "\n";
+    for (size_t v = 1; v <= nvars; ++v) {
+        if (v % 10 == 1)
+            text += "c ind";
+        text += " " + std::to_string(v);
+        if (v % 10 == 0 || v == nvars)
+            text += " 0\n";
+    }
+    for (size_t k = 0; k < nclauses; ++k) {
+        for (int j = 0; j < 3; ++j) {
+            long v = 1 + rng() % total;
+            text += std::to_string(rng() & 1 ? v : -v);
+            text += ' ';
+        }
+        text += "0\n";
+    }
+    return text;
+}
+
+static void bench_parse(size_t nvars, std::mt19937_64 & rng) {
+    std::string text = synthetic_cnf(nvars, rng);
+    const int reps = 5;
+    double start = now();
+    for (int r = 0; r < reps; ++r) {
+        Formula f;
+        DimacsLoader::parse(text.data(), text.size(), f);
+        sink += f.lits.size() + f.ind.size();
+    }
+    double t = now() - start;
+    printf("%-16s %8zu vars %10.1f MB/s\n", "parse", nvars, reps * text.size() / t / 1.0e6);
+}
+
+static void bench_extract(size_t nvars, std::mt19937_64 & rng) {
+    z3::context c;
+    VarTable vars(c);
+    std::vector<int> ind;
+    for (size_t v = 1; v <= nvars; ++v)
+        ind.push_back(v);
+    vars.init(nvars, ind);
+    Z3_model raw = Z3_mk_model(c);
+    z3::model m(c, raw);
+    for (size_t i = 0; i < nvars; ++i) {
+        z3::expr x = vars.ind_lit(i, true);
+        Z3_add_const_interp(c, m, x.decl(), rng() & 1 ? c.bool_val(true) : c.bool_val(false));
+    }
+    Sample s;
+    size_t ops = 20000000 / nvars + 1;
+    double start = now();
+    for (size_t r = 0; r < ops; ++r) {
+        vars.extract(m, s);
+        sink += s.words()[0];
+    }
+    report("extract", nvars, ops, now() - start);
+}
+
+static void bench_combine(size_t nvars, std::mt19937_64 & rng) {
+    Sample base = random_sample(nvars, rng);
+    std::vector<Sample> others;
+    for (int k = 0; k < 64; ++k)
+        others.push_back(random_sample(nvars, rng));
+    Sample out;
+    size_t ops = 400000000 / nvars + 1;
+    double start = now();
+    for (size_t r = 0; r < ops; ++r) {
+        Sample::combine(base, others[r & 63], others[(r * 7 + 1) & 63], out);
+        sink += out.words()[0];
+    }
+    report("combine", nvars, ops, now() - start);
+}
+
+// The combination loop of an epoch, as the sampler runs it: every
+// candidate is combined, looked up in the epoch's mutations and kept.
+static void bench_mutations(size_t nvars, std::mt19937_64 & rng) {
+    Sample base = random_sample(nvars, rng);
+    size_t ops = 20000000 / nvars + 1000;
+    double start = now();
+    Epoch e(0, base, ops, (size_t)1 << 40, nullptr);
+    for (int k = 0; k < 256; ++k) {
+        Sample f = base;
+        f.flip(rng() % nvars);
+        f.flip(rng() % nvars);
+        e.add_flip(f, k);
+    }
+    e.combine((size_t)-1, [&](bool fresh, int, size_t) {
+        sink += fresh;
+    });
+    report("mutations", nvars, e.generated, now() - start);
+}
+
+static void bench_dedup(const char * kind, size_t nvars, std::mt19937_64 & rng) {
+    std::vector<Sample> samples;
+    for (int k = 0; k < 1024; ++k)
+        samples.push_back(random_sample(nvars, rng));
+    std::unique_ptr<SampleFilter> filter(SampleFilter::create(kind, 64 << 20));
+    size_t ops = 50000000 / nvars + 1000;
+    double start = now();
+    for (size_t r = 0; r < ops; ++r) {
+        Sample & s = samples[r & 1023];
+        s.flip(r % nvars);
+        sink += filter->insert(s);
+    }
+    report(kind[0] == 'e' ? "dedup exact" : "dedup bloom", nvars, ops, now() - start);
+}
+
+static void bench_output(bool binary, size_t nvars, std::mt19937_64 & rng) {
+    std::vector<Sample> samples;
+    for (int k = 0; k < 64; ++k)
+        samples.push_back(random_sample(nvars, rng));
+    BufferedWriter out;
+    if (!out.open("/dev/null")) {
+        printf("Error opening /dev/null\n");
+        abort();
+    }
+    std::string buffer;
+    size_t ops = 200000000 / nvars + 1;
+    double start = now();
+    for (size_t r = 0; r < ops; ++r) {
+        if (binary)
+            sample_format::append_binary(buffer, samples[r & 63], r % 7);
+        else
+            sample_format::append_text(buffer, samples[r & 63], r % 7);
+        if (buffer.size() >= (1 << 16)) {
+            out.write(buffer);
+            buffer.clear();
+        }
+    }
+    out.write(buffer);
+    out.close();
+    report(binary ? "output binary" : "output text", nvars, ops, now() - start);
+}
+
+int main(int argc, char * argv[]) {
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes.push_back(atol(argv[i]));
+    if (sizes.empty())
+        sizes = {1000, 10000, 100000};
+    for (size_t n : sizes) {
+        std::mt19937_64 rng(n);
+        bench_parse(n, rng);
+        bench_extract(n, rng);
+        bench_combine(n, rng);
+        bench_mutations(n, rng);
+        bench_dedup("exact", n, rng);
+        bench_dedup("bloom", n, rng);
+        bench_output(false, n, rng);
+        bench_output(true, n, rng);
+    }
+    return 0;
+}
@@ -0,0 +1,196 @@
+#!/usr/bin/env python3
+"""End-to-end benchmark of QuickSampler over formulas from Benchmarks/.
+
+Every formula is copied to a scratch directory and sampled with a fixed
+seed and time budget. The statistics printed by the sampler, the distinct
+samples in its output, and the peak RSS of the process are recorded in a
+JSON file. With --z3, the samples are also validated by a z3 built with the
+files under check/, giving the valid fraction per mutation depth. With
+--baseline, the results are compared with an earlier run and regressions
+are reported; the exit status is 1 if there are any.
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+DEFAULT_FORMULAS = [
+    'polynomial.sk_7_25.cnf',
+    'registerlesSwap.sk_3_10.cnf',
+    '10.sk_1_46.cnf',
+    'GuidanceService2.sk_2_27.cnf',
+]
+
+# Metrics where larger is better, and where smaller is better.
+HIGHER = ['samples_per_sec', 'unique_per_sec', 'valid_fraction']
+LOWER = ['peak_rss_kb']
+
+
+def run(cmd, cwd, limit=None):
+    """Runs cmd, killing it after limit seconds, and returns its output, the
+    peak RSS of the child in KB, the wall time and the exit status."""
+    start = time.time()
+    proc = subprocess.Popen(cmd, cwd=cwd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    timer = threading.Timer(limit, proc.kill) if limit else None
+    if timer:
+        timer.start()
+    out = b''
+    while True:
+        chunk = proc.stdout.read(1 << 16)
+        if not chunk:
+            break
+        out += chunk
+    _, status, usage = os.wait4(proc.pid, 0)
+    if timer:
+        timer.cancel()
+    return out.decode(errors='replace'), usage.ru_maxrss, time.time() - start, status
+
+
+def last(pattern, text, default=0.0):
+    found = re.findall(pattern, text, re.M)
+    return float(found[-1]) if found else default
+
+
+def parse_stats(out):
+    stats = {
+        'samples': int(last(r'^Samples (\d+)', out)),
+        'time': last(r'^Execution time ([\d.e+-]+)', out),
+        'solver_time': last(r'^Solver time: ([\d.e+-]+)', out),
+        'epochs': int(last(r'^Epochs (\d+)', out)),
+        'flips': int(last(r'^Epochs \d+, Flips (\d+)', out)),
+        'solver_calls': int(last(r'Calls (\d+)$', out)),
+        'duplicates': int(last(r'^Duplicates (\d+)', out)),
+    }
+    return stats
+
+
+def count_samples(path):
+    lines = 0
+    distinct = set()
+    with open(path, 'rb') as f:
+        for line in f:
+            lines += 1
+            distinct.add(line.split(b' ', 1)[-1])
+    return lines, len(distinct)
+
+
+def check(z3, cnf, workdir, timeout):
+    """Returns the valid fraction per depth and overall from the checker."""
+    out, _, _, _ = run([z3, 'sat.quicksampler_check=true',
+                        'sat.quicksampler_check.timeout=%s' % timeout, cnf], workdir)
+    depths = {}
+    rows = re.search(r'^Mutations\n((?:\d+ \d+ \d+ \d+\n)+)', out, re.M)
+    if rows:
+        for row in rows.group(1).splitlines():
+            d, valid, invalid, _ = (int(x) for x in row.split())
+            if valid + invalid:
+                depths[str(d)] = valid / (valid + invalid)
+    overall = re.search(r'^[\d.]+ / \d+ = ([\d.]+)', out, re.M)
+    return depths, float(overall.group(1)) if overall else None
+
+
+def bench(args, name):
+    source = os.path.join(ROOT, 'Benchmarks', name)
+    workdir = tempfile.mkdtemp(prefix='qsbench')
+    try:
+        cnf = os.path.join(workdir, os.path.basename(name))
+        shutil.copy(source, cnf)
+        cmd = [args.sampler, '-s', str(args.seed), '-t', str(args.time), '-o', 'text']
+        cmd += args.sampler_args.split() + [cnf]
+        out, rss, wall, status = run(cmd, workdir, 2 * args.time + 30)
+        stats = parse_stats(out)
+        lines, distinct = count_samples(cnf + '.samples')
+        elapsed = stats['time'] or wall
+        result = dict(stats)
+        result.update({
+            'exit_status': status,
+            'lines': lines,
+            'unique': distinct,
+            'samples_per_sec': lines / elapsed if elapsed else 0.0,
+            'unique_per_sec': distinct / elapsed if elapsed else 0.0,
+            'solver_share': stats['solver_time'] / elapsed if elapsed else 0.0,
+            'peak_rss_kb': rss,
+        })
+        if args.z3:
+            depths, overall = check(args.z3, cnf, workdir, args.check_timeout)
+            result['valid_fraction_by_depth'] = depths
+            result['valid_fraction'] = overall
+        return result
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+
+def compare(results, baseline, tolerance):
+    """Returns a list of regressions of results against baseline."""
+    regressions = []
+    for name, now in sorted(results.items()):
+        before = baseline.get(name)
+        if not before:
+            continue
+        for key in HIGHER + LOWER:
+            a, b = before.get(key), now.get(key)
+            if a is None or b is None or a == 0:
+                continue
+            change = (b - a) / abs(a)
+            worse = change < -tolerance if key in HIGHER else change > tolerance
+            if worse:
+                regressions.append('%s: %s %.4g -> %.4g (%+.1f%%)' % (name, key, a, b, 100 * change))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('formulas', nargs='*', help='formulas under Benchmarks/ (default: a small fast set)')
+    parser.add_argument('--sampler', default=os.path.join(ROOT, 'quicksampler'))
+    parser.add_argument('--sampler-args', default='', help='extra options for the sampler, e.g. "-b solver -j 4"')
+    parser.add_argument('--time', type=float, default=10.0, help='time budget per formula, in seconds')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--z3', help='z3 built with check/, to validate the samples')
+    parser.add_argument('--check-timeout', type=float, default=60.0)
+    parser.add_argument('--output', default=os.path.join(ROOT, 'bench', 'results.json'))
+    parser.add_argument('--baseline', help='earlier results to compare with')
+    parser.add_argument('--tolerance', type=float, default=0.10, help='relative change counted as a regression')
+    args = parser.parse_args()
+
+    results = {}
+    for name in args.formulas or DEFAULT_FORMULAS:
+        result = bench(args, name)
+        results[name] = result
+        print('%-40s %8.1f samples/s %8.1f unique/s  solver %3.0f%%  calls %6d  rss %7d KB' % (
+            name, result['samples_per_sec'], result['unique_per_sec'],
+            100 * result['solver_share'], result['solver_calls'], result['peak_rss_kb']))
+        if 'valid_fraction' in result:
+            print('%-40s valid %s %s' % ('', result['valid_fraction'], result['valid_fraction_by_depth']))
+
+    report = {
+        'config': {'sampler_args': args.sampler_args, 'time': args.time, 'seed': args.seed},
+        'results': results,
+    }
+    with open(args.output, 'w') as f:
+        json.dump(report, f, indent=2, sort_keys=True)
+    print('Results in %s' % args.output)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if baseline.get('config') != report['config']:
+            print('Warning: baseline was run with %s' % baseline.get('config'))
+        regressions = compare(results, baseline.get('results', {}), args.tolerance)
+        for r in regressions:
+            print('Regression: ' + r)
+        if regressions:
+            sys.exit(1)
+        print('No regressions against %s' % args.baseline)
+
+
+if __name__ == '__main__':
+    main()
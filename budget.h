@@ -0,0 +1,59 @@
+#ifndef QUICKSAMPLER_BUDGET_H
+#define QUICKSAMPLER_BUDGET_H
+
+#include <stdint.h>
+#include <atomic>
+
+// A time limit for one kind of solver call, factor times the running 90th
+// percentile of their latency. Latencies go into a histogram of power-of-two
+// buckets of microseconds, so the limit only changes when the percentile
+// moves to another bucket. A call stopped by the limit is counted at the
+// limit: once more than a tenth of the calls hit it, the percentile reaches
+// the limit and the next limit is factor times larger. There is no limit
+// until min_calls calls have been seen, nor below min_seconds. Shared by all
+// workers.
+class CallBudget {
+    enum { num_buckets = 40 };
+    std::atomic<uint64_t> buckets[num_buckets];
+    std::atomic<uint64_t> calls{0};
+    double factor;
+
+public:
+    enum { min_calls = 16 };
+    static constexpr double min_seconds = 0.01;
+
+    explicit CallBudget(double factor) : factor(factor) {
+        for (auto & b : buckets)
+            b = 0;
+    }
+
+    void record(double seconds) {
+        uint64_t us = seconds > 0 ? (uint64_t)(seconds * 1.0e6) : 0;
+        int b = us == 0 ? 0 : 64 - __builtin_clzll(us);
+        if (b >= num_buckets)
+            b = num_buckets - 1;
+        buckets[b].fetch_add(1, std::memory_order_relaxed);
+        calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Seconds for the next call; 0 for no limit.
+    double limit() const {
+        uint64_t n = calls.load(std::memory_order_relaxed);
+        if (n < min_calls)
+            return 0;
+        uint64_t rank = n - n / 10;
+        uint64_t seen = 0;
+        int b = 0;
+        for (; b < num_buckets - 1; ++b) {
+            seen += buckets[b].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                break;
+        }
+        // The end of bucket b, in seconds.
+        double p90 = (double)((uint64_t)1 << b) * 1.0e-6;
+        double s = factor * p90;
+        return s < min_seconds ? min_seconds : s;
+    }
+};
+
+#endif
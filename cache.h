@@ -0,0 +1,299 @@
+#ifndef QUICKSAMPLER_CACHE_H
+#define QUICKSAMPLER_CACHE_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "dimacs.h"
+#include "preprocess.h"
+
+// A compiled image of a parsed formula, kept next to the CNF as FILE.qsc so
+// later runs map it instead of parsing the text again. It is keyed by a
+// 128-bit hash of the CNF's contents, so an edited file is parsed again.
+// Images are in native byte order; one from another platform fails the
+// magic check and is rebuilt.
+//
+// Layout, every array padded to 8 bytes:
+//     char     magic[4]      "QSFC"
+//     uint32_t version       1
+//     uint64_t hash[2]       of the CNF
+//     uint64_t size          of the CNF
+//     uint64_t reduced       1 if a Reduction follows the formula
+//     formula:   int64 max_var; then int32 ind[], int32 lits[] and
+//                uint64 start[] (nclauses + 1 entries), each array as an
+//                int64 count followed by its elements
+//     reduction: uint64 units, pure, backbone; a formula as above;
+//                int32 free_positions[]; int8 value[]
+class FormulaCache {
+    std::string cnf;
+    std::string image;
+    uint64_t hash[2] = {0, 0};
+    uint64_t size = 0;
+    bool hashed = false;
+
+    static const uint32_t version = 1;
+
+public:
+    explicit FormulaCache(const std::string & cnf) : cnf(cnf), image(cnf + ".qsc") {}
+
+    // Loads the formula, and the reduction if the image has one and reduced
+    // is not null. Returns false if there is no image of the current CNF.
+    bool load(Formula & f, Reduction * reduced, bool & has_reduction) {
+        has_reduction = false;
+        if (!hash_source())
+            return false;
+        int fd = open(image.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < 40) {
+            close(fd);
+            return false;
+        }
+        size_t n = st.st_size;
+        void * p = mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            return false;
+        Reader r{(const char *)p, (const char *)p + n};
+        bool ok = read_header(r, has_reduction) && read_formula(r, f);
+        if (ok && has_reduction && reduced)
+            ok = read_reduction(r, *reduced) && matches(f, *reduced);
+        if (!ok || !reduced)
+            has_reduction = false;
+        // A formula read in part must not be mixed with the one parsed next.
+        if (!ok)
+            f = Formula();
+        munmap(p, n);
+        return ok;
+    }
+
+    // Writes the image aside and renames it into place; a failure leaves the
+    // old image, if any, and is otherwise ignored.
+    void save(const Formula & f, const Reduction * reduced) {
+        if (!hash_source())
+            return;
+        std::string out(magic(), 4);
+        put<uint32_t>(out, version);
+        put<uint64_t>(out, hash[0]);
+        put<uint64_t>(out, hash[1]);
+        put<uint64_t>(out, size);
+        put<uint64_t>(out, reduced ? 1 : 0);
+        write_formula(out, f);
+        if (reduced) {
+            put<uint64_t>(out, reduced->units);
+            put<uint64_t>(out, reduced->pure);
+            put<uint64_t>(out, reduced->backbone);
+            write_formula(out, reduced->formula);
+            put_array(out, reduced->free_positions);
+            put_array(out, reduced->value);
+        }
+        // A temporary file of its own, so concurrent runs on the same CNF
+        // never rename each other's partial images into place.
+        std::string tmp = image + ".XXXXXX";
+        int fd = mkstemp(&tmp[0]);
+        if (fd < 0)
+            return;
+        fchmod(fd, 0644);
+        FILE * file = fdopen(fd, "wb");
+        if (!file) {
+            close(fd);
+            unlink(tmp.c_str());
+            return;
+        }
+        bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), image.c_str()) != 0)
+            unlink(tmp.c_str());
+    }
+
+private:
+    static const char * magic() {
+        return "QSFC";
+    }
+
+    struct Reader {
+        const char * p;
+        const char * end;
+
+        template <typename T>
+        bool get(T & v) {
+            if (end - p < (long)sizeof(T))
+                return false;
+            memcpy(&v, p, sizeof(T));
+            p += sizeof(T);
+            return true;
+        }
+
+        template <typename T>
+        bool get_array(std::vector<T> & v) {
+            int64_t n;
+            if (!get(n) || n < 0 || (uint64_t)n > (uint64_t)(end - p) / sizeof(T))
+                return false;
+            // Copied straight from the mapping, without zeroing first.
+            const T * data = (const T *)p;
+            v.assign(data, data + n);
+            p += pad(n * sizeof(T));
+            return p <= end;
+        }
+    };
+
+    static size_t pad(size_t n) {
+        return (n + 7) & ~(size_t)7;
+    }
+
+    template <typename T>
+    static void put(std::string & out, T v) {
+        out.append((const char *)&v, sizeof(T));
+    }
+
+    template <typename T>
+    static void put_array(std::string & out, const std::vector<T> & v) {
+        put<int64_t>(out, v.size());
+        out.append((const char *)v.data(), v.size() * sizeof(T));
+        out.resize(out.size() + pad(v.size() * sizeof(T)) - v.size() * sizeof(T), '\0');
+    }
+
+    static void write_formula(std::string & out, const Formula & f) {
+        put<int64_t>(out, f.max_var);
+        put_array(out, f.ind);
+        put_array(out, f.lits);
+        put_array(out, f.start);
+    }
+
+    bool read_header(Reader & r, bool & has_reduction) {
+        char m[4];
+        uint32_t v;
+        uint64_t h0, h1, sz, red;
+        if (!r.get(m) || memcmp(m, magic(), 4) != 0 || !r.get(v) || v != version)
+            return false;
+        if (!r.get(h0) || !r.get(h1) || !r.get(sz) || !r.get(red))
+            return false;
+        if (h0 != hash[0] || h1 != hash[1] || sz != size)
+            return false;
+        has_reduction = red == 1;
+        return true;
+    }
+
+    static bool read_formula(Reader & r, Formula & f) {
+        static_assert(sizeof(size_t) == sizeof(uint64_t), "clause offsets are read in place");
+        int64_t max_var;
+        if (!r.get(max_var) || !r.get_array(f.ind) || !r.get_array(f.lits) || !r.get_array(f.start))
+            return false;
+        const std::vector<size_t> & start = f.start;
+        if (start.empty() || start.front() != 0 || start.back() != f.lits.size())
+            return false;
+        for (size_t k = 1; k < start.size(); ++k)
+            if (start[k] < start[k - 1])
+                return false;
+        // Every variable must be in range before the arrays are indexed by
+        // it. A support beyond the variables of the clauses is not accepted,
+        // so such a formula is parsed again each time.
+        if (max_var <= 0 || max_var > INT_MAX)
+            return false;
+        for (int l : f.lits)
+            if (l == 0 || l < -max_var || l > max_var)
+                return false;
+        for (int v : f.ind)
+            if (v <= 0 || v > max_var)
+                return false;
+        f.max_var = max_var;
+        return true;
+    }
+
+    static bool read_reduction(Reader & r, Reduction & out) {
+        return r.get(out.units) && r.get(out.pure) && r.get(out.backbone) &&
+               read_formula(r, out.formula) && r.get_array(out.free_positions) && r.get_array(out.value);
+    }
+
+    // Whether a reduction read back fits the formula: a value per variable,
+    // and the reduced support at increasing positions of the support.
+    static bool matches(const Formula & f, const Reduction & red) {
+        int nvars = f.max_var;
+        for (int v : f.ind)
+            nvars = std::max(nvars, v);
+        if (red.formula.max_var != nvars || red.value.size() != (size_t)nvars + 1)
+            return false;
+        for (signed char x : red.value)
+            if (x < -1 || x > 1)
+                return false;
+        if (red.free_positions.size() != red.formula.ind.size())
+            return false;
+        for (size_t k = 0; k < red.free_positions.size(); ++k) {
+            int i = red.free_positions[k];
+            if (i < 0 || (size_t)i >= f.ind.size() || (k > 0 && i <= red.free_positions[k - 1]))
+                return false;
+            if (red.formula.ind[k] != f.ind[i])
+                return false;
+        }
+        return true;
+    }
+
+    // Four multiply-xorshift lanes, as in Sample::hash128, over the bytes of
+    // the CNF read through mmap. The lanes are independent so the
+    // multiplications overlap, and the hash runs at memory speed.
+    bool hash_source() {
+        if (hashed)
+            return true;
+        int fd = open(cnf.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        size = st.st_size;
+        uint64_t h[4] = {0x243f6a8885a308d3ULL ^ size, 0x13198a2e03707344ULL + size, 0xa4093822299f31d0ULL, 0x082efa98ec4e6c89ULL};
+        if (size > 0) {
+            void * p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                return false;
+            }
+            madvise(p, size, MADV_SEQUENTIAL);
+            const char * data = (const char *)p;
+            size_t k = 0;
+            for (; k + 32 <= size; k += 32) {
+                for (int l = 0; l < 4; ++l) {
+                    uint64_t w;
+                    memcpy(&w, data + k + 8 * l, 8);
+                    h[l] = (h[l] ^ w) * 0x87c37b91114253d5ULL;
+                    h[l] ^= h[l] >> 31;
+                }
+            }
+            char tail[32] = {0};
+            memcpy(tail, data + k, size - k);
+            for (int l = 0; l < 4; ++l) {
+                uint64_t w;
+                memcpy(&w, tail + 8 * l, 8);
+                h[l] = (h[l] ^ w) * 0x87c37b91114253d5ULL;
+                h[l] ^= h[l] >> 31;
+            }
+            munmap(p, size);
+        }
+        close(fd);
+        uint64_t a = (h[0] ^ rotl(h[2], 29)) * 0x4cf5ad432745937fULL;
+        uint64_t b = (h[1] ^ rotl(h[3], 29)) * 0x4cf5ad432745937fULL;
+        hash[0] = a ^ (b >> 31);
+        hash[1] = b ^ (a >> 29) ^ rotl(h[2], 17);
+        hashed = true;
+        return true;
+    }
+
+    static uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+};
+
+#endif
@@ -0,0 +1,542 @@
+#ifndef QUICKSAMPLER_CDCL_H
+#define QUICKSAMPLER_CDCL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <vector>
+
+// A small CDCL solver for pure CNF: two watched literals, first-UIP
+// learning, VSIDS, phase saving and Luby restarts. Callers steer the search
+// through the saved phases, which is how the sampler keeps models close to a
+// base assignment without paying for MaxSAT.
+//
+// Variables are numbered from 1 as in DIMACS. Internally literal 2*v is v
+// and 2*v+1 is its negation.
+class Cdcl {
+public:
+    enum Result { SAT, UNSAT, UNKNOWN };
+
+private:
+    struct Watch {
+        uint32_t cref;
+        int blocker;
+    };
+
+    int nvars = 0;
+    bool ok = true;
+    // Clause arena: size, learnt flag, then the literals.
+    std::vector<int> arena;
+    std::vector<uint32_t> learnts;
+    std::vector<std::vector<Watch>> watches;
+
+    std::vector<signed char> vals;
+    std::vector<int> level;
+    std::vector<uint32_t> reason;
+    std::vector<char> phase;
+    std::vector<char> model;
+    std::vector<int> trail;
+    std::vector<size_t> trail_lim;
+    size_t qhead = 0;
+
+    std::vector<double> activity;
+    double var_inc = 1.0;
+    std::vector<int> heap;
+    std::vector<int> heap_pos;
+
+    std::vector<char> seen;
+    std::vector<int> learnt_clause;
+    std::vector<int> analyze_toclear;
+    std::mt19937 rng;
+    double random_freq = 0.01;
+    size_t max_learnts = 20000;
+    std::atomic<bool> interrupted{false};
+    // Seconds allowed per solve(), 0 for no limit, and the end of the
+    // current one in CLOCK_MONOTONIC seconds.
+    double time_limit = 0;
+    double deadline = 0;
+
+    enum : uint32_t { NO_REASON = 0xffffffff };
+
+public:
+    uint64_t conflicts = 0;
+    uint64_t decisions = 0;
+    uint64_t propagations = 0;
+
+    Cdcl(unsigned seed = 0) : rng(seed) {}
+
+    int num_vars() const { return nvars; }
+
+    void reserve_vars(int n) {
+        if (n <= nvars)
+            return;
+        vals.resize(2 * (n + 1), 0);
+        watches.resize(2 * (n + 1));
+        level.resize(n + 1, 0);
+        reason.resize(n + 1, NO_REASON);
+        phase.resize(n + 1, 0);
+        model.resize(n + 1, 0);
+        activity.resize(n + 1, 0.0);
+        seen.resize(n + 1, 0);
+        heap_pos.resize(n + 1, -1);
+        for (int v = nvars + 1; v <= n; ++v)
+            heap_insert(v);
+        nvars = n;
+    }
+
+    // Adds a clause of DIMACS literals at decision level 0. Returns false once
+    // the formula is known to be unsatisfiable.
+    bool add_clause(const int * begin, const int * end) {
+        if (!ok)
+            return false;
+        std::vector<int> lits;
+        for (const int * l = begin; l != end; ++l) {
+            int v = abs(*l);
+            reserve_vars(v);
+            lits.push_back(2 * v + (*l < 0));
+        }
+        std::sort(lits.begin(), lits.end());
+        size_t j = 0;
+        for (size_t i = 0; i < lits.size(); ++i) {
+            if (j > 0 && lits[i] == (lits[j - 1] ^ 1))
+                return true;
+            if (value(lits[i]) > 0)
+                return true;
+            if (value(lits[i]) < 0 || (j > 0 && lits[i] == lits[j - 1]))
+                continue;
+            lits[j++] = lits[i];
+        }
+        lits.resize(j);
+        if (lits.empty())
+            return ok = false;
+        if (lits.size() == 1) {
+            assign(lits[0], NO_REASON);
+            return ok = propagate() == NO_REASON;
+        }
+        attach(alloc(lits, false));
+        return true;
+    }
+
+    void set_phase(int v, bool b) {
+        phase[v] = b;
+    }
+
+    void set_random_freq(double f) {
+        random_freq = f;
+    }
+
+    // Every later solve() gives up with UNKNOWN after that many seconds; 0
+    // for no limit. The clock is read every 256 conflicts.
+    void set_time_limit(double seconds) {
+        time_limit = seconds;
+    }
+
+    // The value of v in the last model found.
+    bool model_value(int v) const {
+        return v > 0 && v <= nvars && model[v];
+    }
+
+    // Value of v fixed at decision level 0: 1 true, -1 false, 0 free.
+    int fixed_value(int v) const {
+        return v > 0 && v <= nvars ? vals[2 * v] : 0;
+    }
+
+    // Stops the running solve() and every later one, which return UNKNOWN.
+    // The flag is never cleared, so an interrupt that comes just before a
+    // call is not lost.
+    void interrupt() {
+        interrupted = true;
+    }
+
+    // Solves under the given DIMACS literal assumptions. UNSAT without
+    // assumptions means the formula itself is unsatisfiable.
+    Result solve(const std::vector<int> & assumptions = std::vector<int>()) {
+        deadline = time_limit > 0 ? now() + time_limit : 0;
+        if (!ok)
+            return UNSAT;
+        std::vector<int> assume;
+        for (int a : assumptions) {
+            reserve_vars(abs(a));
+            assume.push_back(2 * abs(a) + (a < 0));
+        }
+        Result result = UNKNOWN;
+        for (int restarts = 0; result == UNKNOWN; ++restarts) {
+            if (interrupted || expired())
+                break;
+            result = search(100 * luby(restarts), assume);
+            cancel_until(0);
+            if (learnts.size() > max_learnts + trail.size())
+                reduce_db();
+        }
+        cancel_until(0);
+        return result;
+    }
+
+private:
+    static double now() {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + 1.0e-9 * t.tv_nsec;
+    }
+
+    bool expired() const {
+        return deadline > 0 && now() > deadline;
+    }
+
+    signed char value(int lit) const {
+        return vals[lit];
+    }
+
+    uint32_t alloc(const std::vector<int> & lits, bool learnt) {
+        uint32_t cref = arena.size();
+        arena.push_back(lits.size());
+        arena.push_back(learnt);
+        arena.insert(arena.end(), lits.begin(), lits.end());
+        return cref;
+    }
+
+    int * lits_of(uint32_t cref) { return &arena[cref + 2]; }
+    int size_of(uint32_t cref) const { return arena[cref]; }
+
+    void attach(uint32_t cref) {
+        int * c = lits_of(cref);
+        watches[c[0]].push_back(Watch{cref, c[1]});
+        watches[c[1]].push_back(Watch{cref, c[0]});
+    }
+
+    int decision_level() const {
+        return trail_lim.size();
+    }
+
+    void assign(int lit, uint32_t from) {
+        int v = lit >> 1;
+        vals[lit] = 1;
+        vals[lit ^ 1] = -1;
+        level[v] = decision_level();
+        reason[v] = from;
+        trail.push_back(lit);
+    }
+
+    // Returns the conflicting clause, or NO_REASON.
+    uint32_t propagate() {
+        uint32_t conflict = NO_REASON;
+        while (qhead < trail.size()) {
+            int p = trail[qhead++];
+            int false_lit = p ^ 1;
+            std::vector<Watch> & ws = watches[false_lit];
+            size_t i = 0, j = 0;
+            propagations += 1;
+            while (i < ws.size()) {
+                Watch w = ws[i++];
+                if (value(w.blocker) > 0) {
+                    ws[j++] = w;
+                    continue;
+                }
+                int * c = lits_of(w.cref);
+                int n = size_of(w.cref);
+                if (c[0] == false_lit)
+                    std::swap(c[0], c[1]);
+                if (value(c[0]) > 0) {
+                    ws[j++] = Watch{w.cref, c[0]};
+                    continue;
+                }
+                bool moved = false;
+                for (int k = 2; k < n; ++k) {
+                    if (value(c[k]) >= 0) {
+                        std::swap(c[1], c[k]);
+                        watches[c[1]].push_back(Watch{w.cref, c[0]});
+                        moved = true;
+                        break;
+                    }
+                }
+                if (moved)
+                    continue;
+                ws[j++] = Watch{w.cref, c[0]};
+                if (value(c[0]) < 0) {
+                    conflict = w.cref;
+                    qhead = trail.size();
+                    while (i < ws.size())
+                        ws[j++] = ws[i++];
+                } else {
+                    assign(c[0], w.cref);
+                }
+            }
+            ws.resize(j);
+            if (conflict != NO_REASON)
+                break;
+        }
+        return conflict;
+    }
+
+    // First-UIP conflict analysis. Leaves the learnt clause in learnt_clause
+    // with the asserting literal first and returns the backjump level.
+    int analyze(uint32_t conflict) {
+        learnt_clause.clear();
+        learnt_clause.push_back(0);
+        int pending = 0;
+        int p = -1;
+        size_t index = trail.size();
+        do {
+            int * c = lits_of(conflict);
+            int n = size_of(conflict);
+            for (int k = (p == -1 ? 0 : 1); k < n; ++k) {
+                int q = c[k];
+                int v = q >> 1;
+                if (!seen[v] && level[v] > 0) {
+                    bump(v);
+                    seen[v] = 1;
+                    if (level[v] >= decision_level())
+                        pending += 1;
+                    else
+                        learnt_clause.push_back(q);
+                }
+            }
+            while (!seen[trail[--index] >> 1]);
+            p = trail[index];
+            conflict = reason[p >> 1];
+            seen[p >> 1] = 0;
+            pending -= 1;
+        } while (pending > 0);
+        learnt_clause[0] = p ^ 1;
+
+        // Drop literals implied by the rest of the clause through their
+        // reason alone.
+        analyze_toclear = learnt_clause;
+        size_t j = 1;
+        for (size_t k = 1; k < learnt_clause.size(); ++k) {
+            int v = learnt_clause[k] >> 1;
+            uint32_t r = reason[v];
+            bool redundant = r != NO_REASON;
+            if (redundant) {
+                int * c = lits_of(r);
+                int n = size_of(r);
+                for (int m = 1; m < n; ++m) {
+                    int u = c[m] >> 1;
+                    if (!seen[u] && level[u] > 0) {
+                        redundant = false;
+                        break;
+                    }
+                }
+            }
+            if (!redundant)
+                learnt_clause[j++] = learnt_clause[k];
+        }
+        learnt_clause.resize(j);
+
+        int back = 0;
+        if (learnt_clause.size() > 1) {
+            size_t max_i = 1;
+            for (size_t k = 2; k < learnt_clause.size(); ++k)
+                if (level[learnt_clause[k] >> 1] > level[learnt_clause[max_i] >> 1])
+                    max_i = k;
+            std::swap(learnt_clause[1], learnt_clause[max_i]);
+            back = level[learnt_clause[1] >> 1];
+        }
+        for (int q : analyze_toclear)
+            seen[q >> 1] = 0;
+        return back;
+    }
+
+    void cancel_until(int lvl) {
+        if (decision_level() <= lvl)
+            return;
+        for (size_t k = trail.size(); k > trail_lim[lvl]; --k) {
+            int lit = trail[k - 1];
+            int v = lit >> 1;
+            phase[v] = !(lit & 1);
+            vals[lit] = 0;
+            vals[lit ^ 1] = 0;
+            reason[v] = NO_REASON;
+            if (heap_pos[v] < 0)
+                heap_insert(v);
+        }
+        trail.resize(trail_lim[lvl]);
+        trail_lim.resize(lvl);
+        qhead = trail.size();
+    }
+
+    int pick_branch() {
+        if (random_freq > 0 && !heap.empty() && std::uniform_real_distribution<double>(0, 1)(rng) < random_freq) {
+            int v = heap[rng() % heap.size()];
+            if (vals[2 * v] == 0)
+                return 2 * v + !phase[v];
+        }
+        while (!heap.empty()) {
+            int v = heap_pop();
+            if (vals[2 * v] == 0)
+                return 2 * v + !phase[v];
+        }
+        return -1;
+    }
+
+    Result search(uint64_t budget, const std::vector<int> & assume) {
+        uint64_t local = 0;
+        while (true) {
+            uint32_t conflict = propagate();
+            if (conflict != NO_REASON) {
+                conflicts += 1;
+                local += 1;
+                if ((conflicts & 255) == 0 && expired())
+                    return UNKNOWN;
+                if (decision_level() == 0) {
+                    ok = false;
+                    return UNSAT;
+                }
+                int back = analyze(conflict);
+                cancel_until(back);
+                if (learnt_clause.size() == 1) {
+                    assign(learnt_clause[0], NO_REASON);
+                } else {
+                    uint32_t cref = alloc(learnt_clause, true);
+                    attach(cref);
+                    learnts.push_back(cref);
+                    assign(learnt_clause[0], cref);
+                }
+                var_inc /= 0.95;
+                continue;
+            }
+            if (interrupted)
+                return UNKNOWN;
+            if (local >= budget)
+                return UNKNOWN;
+            int next = -1;
+            while (decision_level() < (int)assume.size()) {
+                int a = assume[decision_level()];
+                if (value(a) > 0) {
+                    trail_lim.push_back(trail.size());
+                } else if (value(a) < 0) {
+                    return UNSAT;
+                } else {
+                    next = a;
+                    break;
+                }
+            }
+            if (next < 0) {
+                decisions += 1;
+                next = pick_branch();
+                if (next < 0) {
+                    for (int v = 1; v <= nvars; ++v)
+                        model[v] = vals[2 * v] > 0;
+                    return SAT;
+                }
+            }
+            trail_lim.push_back(trail.size());
+            assign(next, NO_REASON);
+        }
+    }
+
+    // Drops the less useful half of the learnt clauses, longest first, and
+    // rebuilds the watch lists. Only called at decision level 0.
+    void reduce_db() {
+        std::vector<uint32_t> sorted(learnts);
+        std::stable_sort(sorted.begin(), sorted.end(), [this](uint32_t a, uint32_t b) {
+            return size_of(a) < size_of(b);
+        });
+        sorted.resize(sorted.size() / 2);
+        std::vector<char> keep(arena.size(), 0);
+        for (uint32_t cref : sorted)
+            keep[cref] = 1;
+
+        std::vector<int> compact;
+        compact.reserve(arena.size());
+        learnts.clear();
+        for (size_t cref = 0; cref < arena.size(); cref += 2 + arena[cref]) {
+            bool learnt = arena[cref + 1];
+            if (learnt && !keep[cref])
+                continue;
+            if (learnt)
+                learnts.push_back(compact.size());
+            compact.insert(compact.end(), arena.begin() + cref, arena.begin() + cref + 2 + arena[cref]);
+        }
+        arena.swap(compact);
+        for (auto & ws : watches)
+            ws.clear();
+        for (size_t cref = 0; cref < arena.size(); cref += 2 + arena[cref])
+            attach(cref);
+        for (int v = 1; v <= nvars; ++v)
+            reason[v] = NO_REASON;
+        max_learnts += max_learnts / 10;
+    }
+
+    void bump(int v) {
+        activity[v] += var_inc;
+        if (activity[v] > 1e100) {
+            for (int u = 1; u <= nvars; ++u)
+                activity[u] *= 1e-100;
+            var_inc *= 1e-100;
+        }
+        if (heap_pos[v] >= 0)
+            heap_up(heap_pos[v]);
+    }
+
+    static uint64_t luby(int i) {
+        uint64_t size = 1;
+        int seq = 0;
+        while (size < (uint64_t)i + 1) {
+            seq += 1;
+            size = 2 * size + 1;
+        }
+        uint64_t x = i;
+        while (size - 1 != x) {
+            size = (size - 1) >> 1;
+            seq -= 1;
+            x = x % size;
+        }
+        return (uint64_t)1 << seq;
+    }
+
+    void heap_insert(int v) {
+        heap_pos[v] = heap.size();
+        heap.push_back(v);
+        heap_up(heap_pos[v]);
+    }
+
+    int heap_pop() {
+        int top = heap[0];
+        int last = heap.back();
+        heap.pop_back();
+        heap_pos[top] = -1;
+        if (!heap.empty()) {
+            heap[0] = last;
+            heap_pos[last] = 0;
+            heap_down(0);
+        }
+        return top;
+    }
+
+    void heap_up(int i) {
+        int v = heap[i];
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (activity[heap[parent]] >= activity[v])
+                break;
+            heap[i] = heap[parent];
+            heap_pos[heap[i]] = i;
+            i = parent;
+        }
+        heap[i] = v;
+        heap_pos[v] = i;
+    }
+
+    void heap_down(int i) {
+        int v = heap[i];
+        int n = heap.size();
+        while (2 * i + 1 < n) {
+            int child = 2 * i + 1;
+            if (child + 1 < n && activity[heap[child + 1]] > activity[heap[child]])
+                child += 1;
+            if (activity[heap[child]] <= activity[v])
+                break;
+            heap[i] = heap[child];
+            heap_pos[heap[i]] = i;
+            i = child;
+        }
+        heap[i] = v;
+        heap_pos[v] = i;
+    }
+};
+
+#endif
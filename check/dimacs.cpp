@@ -28,6 +28,8 @@ struct lex_error {};
 std::vector<int> indsup;
 std::unordered_set<int> indset;
 bool has_ind = false;
+// The clauses as read, each followed by 0, for the sample checker.
+std::vector<int> dimacs_clauses;
 
 class stream_buffer {
     std::istream & m_stream;
@@ -165,6 +167,9 @@ bool parse_dimacs_core(Buffer & in, std::ostream& err, sat::solver & solver) {
             else {
                 read_clause(in, err, solver, lits);
                 solver.mk_clause(lits.size(), lits.c_ptr());
+                for (sat::literal l : lits)
+                    dimacs_clauses.push_back(l.sign() ? -static_cast<int>(l.var()) : static_cast<int>(l.var()));
+                dimacs_clauses.push_back(0);
             }
         }
     }
@@ -17,9 +17,19 @@ Revision History:
 
 --*/
 #include<iostream>
+#include<algorithm>
+#include<atomic>
+#include<random>
+#include<thread>
 #include<unordered_map>
+#include<unordered_set>
 #include<time.h>
 #include<signal.h>
+#include<fcntl.h>
+#include<string.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
 #include<vector>
 #include "util/timeout.h"
 #include "util/rlimit.h"
@@ -33,10 +43,9 @@ struct cell {
 };
 
 params_ref p;
-reslimit limit;
 extern std::vector<int> indsup;
+extern std::vector<int> dimacs_clauses;
 std::unordered_map<std::string, struct cell> hist;
-double solver_time = 0.0;
 extern bool          g_display_statistics;
 static sat::solver * g_solver = nullptr;
 static clock_t       g_start_time;
@@ -178,37 +187,151 @@ double duration(struct timespec * a, struct timespec * b) {
     return (b->tv_sec - a->tv_sec) + 1.0e-9 * (b->tv_nsec - a->tv_nsec);
 }
 
-bool check_sample(sat::solver & solver, std::string & line) {
-        struct timespec start;
-        clock_gettime(CLOCK_REALTIME, &start);
+// A thread checking samples against its own copy of the formula. Solvers
+// and resource limits are not shared between threads. The solver is kept
+// for all the samples of the thread, which are passed as assumptions, so
+// the clauses it learns carry over from one sample to the next.
+struct check_worker {
+    reslimit limit;
+    sat::solver solver;
+    sat::literal_vector lits;
+    // A batch of samples, one row of bits per support variable.
+    std::vector<uint64_t> rows;
+    double solver_time;
+    int calls;
+    int evaluated;
+
+    check_worker(sat::solver & src) : solver(p, limit), solver_time(0.0), calls(0), evaluated(0) {
+        solver.copy(src);
+    }
+};
+
+// A sample over the independent support, variable k in bit k % 8 of byte
+// k / 8. Packed samples are the keys of hist.
+static bool sample_bit(std::string const & packed, unsigned k) {
+    return (packed[k >> 3] >> (k & 7)) & 1;
+}
+
+// The clauses of the formula as parsed, over the positions of the
+// independent support, for evaluating samples without a solver. Samples
+// are evaluated in batches, transposed so that bit j of a row is the value
+// of one variable in sample j; every clause is then a few ORs over its rows
+// for the whole batch. A clause with variables outside the support is open:
+// a sample that satisfies it through support variables satisfies it, any
+// other needs the solver. When the support covers every variable, no
+// clause is open and no sample needs the solver.
+struct clause_table {
+    // Samples per batch are 64 times this.
+    static const unsigned words = 4;
+    static const unsigned batch = 64 * words;
+
+    // 2 * position + 1 for negative literals.
+    std::vector<unsigned> lits;
+    std::vector<unsigned> start;
+    std::vector<char> open;
+    unsigned num_open;
+
+    clause_table() : num_open(0) {
+        std::vector<int> position;
+        for (unsigned k = 0; k < indsup.size(); ++k) {
+            if (indsup[k] <= 0)
+                continue;
+            if (static_cast<unsigned>(indsup[k]) >= position.size())
+                position.resize(indsup[k] + 1, -1);
+            position[indsup[k]] = k;
+        }
+        start.push_back(0);
+        bool is_open = false;
+        for (int l : dimacs_clauses) {
+            if (l == 0) {
+                start.push_back(lits.size());
+                open.push_back(is_open);
+                num_open += is_open;
+                is_open = false;
+                continue;
+            }
+            unsigned v = abs(l);
+            if (v < position.size() && position[v] >= 0)
+                lits.push_back(2 * position[v] + (l < 0));
+            else
+                is_open = true;
+        }
+    }
+
+    unsigned num_clauses() const { return open.size(); }
+
+    // Fills rows from n <= batch packed samples.
+    void transpose(std::string const * const * samples, unsigned n, std::vector<uint64_t> & rows) const {
+        rows.assign(words * indsup.size(), 0);
+        for (unsigned j = 0; j < n; ++j) {
+            std::string const & s = *samples[j];
+            uint64_t bit = static_cast<uint64_t>(1) << (j & 63);
+            for (unsigned k = 0; k < indsup.size(); ++k)
+                if (sample_bit(s, k))
+                    rows[words * k + (j >> 6)] |= bit;
+        }
+    }
+
+    // Bit j of valid (invalid) is set if sample j of the batch is known to
+    // satisfy (violate) the formula.
+    void eval(std::vector<uint64_t> const & rows, uint64_t * valid, uint64_t * invalid) const {
+        for (unsigned w = 0; w < words; ++w) {
+            valid[w] = ~static_cast<uint64_t>(0);
+            invalid[w] = 0;
+        }
+        for (unsigned k = 0; k < num_clauses(); ++k) {
+            uint64_t sat[words] = {0};
+            for (unsigned i = start[k]; i < start[k + 1]; ++i) {
+                uint64_t const * row = &rows[words * (lits[i] >> 1)];
+                uint64_t flip = (lits[i] & 1) ? ~static_cast<uint64_t>(0) : 0;
+                for (unsigned w = 0; w < words; ++w)
+                    sat[w] |= row[w] ^ flip;
+            }
+            for (unsigned w = 0; w < words; ++w)
+                valid[w] &= sat[w];
+            if (!open[k])
+                for (unsigned w = 0; w < words; ++w)
+                    invalid[w] |= ~sat[w];
+        }
+    }
+};
 
-        sat::solver newsolver(p, limit);
-        newsolver.copy(solver);
-        std::istringstream in(line);
-        int nmut;
-        in >> nmut;
-        char c;
-        in >> c;
-        in >> c;
-        int k = 0;
-        while(!in.eof()) {
-          sat::literal_vector lits;
-          lits.reset();
-          if (c == '0') {
-            lits.push_back(sat::literal(indsup[k], true));
-          } else if (c == '1') {
-            lits.push_back(sat::literal(indsup[k], false));
-          } else {
+// Reads a line "nmut: 0101..." of length n into nmut and a packed sample.
+// Returns false if the line is not a sample.
+static bool parse_line(char const * line, size_t n, int & nmut, std::string & packed) {
+    size_t i = 0;
+    nmut = 0;
+    for (; i < n && line[i] >= '0' && line[i] <= '9'; ++i)
+        nmut = 10 * nmut + (line[i] - '0');
+    if (i == 0 || i == n || line[i] != ':')
+        return false;
+    packed.assign((indsup.size() + 7) / 8, 0);
+    unsigned k = 0;
+    for (++i; i < n; ++i) {
+        char c = line[i];
+        if (c == ' ' || c == '\r')
+            continue;
+        if ((c != '0' && c != '1') || k >= indsup.size()) {
             printf("#%c,%d#", c, c);
             abort();
-          }
-          newsolver.mk_clause(lits.size(), lits.c_ptr());
-
-          in >> c;
-          ++k;
         }
-        lbool r = newsolver.check();
+        if (c == '1')
+            packed[k >> 3] |= 1 << (k & 7);
+        ++k;
+    }
+    return true;
+}
+
+// Checks a sample with the thread's solver.
+bool check_sample(check_worker & w, std::string const & packed) {
+        struct timespec start;
+        clock_gettime(CLOCK_REALTIME, &start);
+
+        w.lits.reset();
+        for (unsigned k = 0; k < indsup.size(); ++k)
+          w.lits.push_back(sat::literal(indsup[k], !sample_bit(packed, k)));
         bool result = false;
+        lbool r = w.solver.check(w.lits.size(), w.lits.c_ptr());
         switch (r) {
           case l_true:
             result = true;
@@ -222,14 +345,99 @@ bool check_sample(sat::solver & solver, std::string & line) {
 
         struct timespec end;
         clock_gettime(CLOCK_REALTIME, &end);
-        solver_time += duration(&start, &end);
+        w.solver_time += duration(&start, &end);
+        ++w.calls;
         return result;
 }
 
-void quicksampler_check(char const * file_name, sat::solver & solver, double timeout) {
+// Checks n <= clause_table::batch samples, by evaluating the clauses where
+// that decides them and with the solver otherwise.
+static void check_batch(check_worker & w, clause_table const & clauses,
+                        std::string const * const * samples, bool * results, unsigned n) {
+    uint64_t valid[clause_table::words];
+    uint64_t invalid[clause_table::words];
+    clauses.transpose(samples, n, w.rows);
+    clauses.eval(w.rows, valid, invalid);
+    for (unsigned j = 0; j < n; ++j) {
+        uint64_t bit = static_cast<uint64_t>(1) << (j & 63);
+        if ((valid[j >> 6] | invalid[j >> 6]) & bit) {
+            results[j] = (valid[j >> 6] & bit) != 0;
+            ++w.evaluated;
+        } else {
+            results[j] = check_sample(w, *samples[j]);
+        }
+    }
+}
+
+// Checks every pending sample, handing them out to the workers in batches.
+// Each result is written to the sample's own cell, so no locks are needed;
+// the counters of the workers are summed by the caller after the join.
+static void check_parallel(std::vector<std::pair<std::string const *, struct cell *>> & pending,
+                           std::vector<check_worker *> & workers,
+                           clause_table const & clauses) {
+    const size_t batch = clause_table::batch;
+    std::atomic<size_t> next(0);
+    auto work = [&](check_worker * w) {
+        std::string const * samples[clause_table::batch];
+        bool results[clause_table::batch];
+        for (size_t b = next.fetch_add(batch); b < pending.size(); b = next.fetch_add(batch)) {
+            unsigned n = static_cast<unsigned>(std::min(batch, pending.size() - b));
+            for (unsigned j = 0; j < n; ++j)
+                samples[j] = pending[b + j].first;
+            check_batch(*w, clauses, samples, results, n);
+            for (unsigned j = 0; j < n; ++j)
+                pending[b + j].second->v = results[j];
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < workers.size(); ++t)
+        threads.push_back(std::thread(work, workers[t]));
+    work(workers[0]);
+    for (auto & t : threads)
+        t.join();
+}
+
+// A uniform random subset of at most capacity lines of a stream
+// (reservoir sampling), with their line numbers.
+struct reservoir {
+    size_t capacity;
+    size_t seen;
+    std::vector<std::pair<size_t, std::string>> items;
+
+    reservoir(size_t capacity = 0) : capacity(capacity), seen(0) {}
+
+    void offer(size_t line, std::string const & packed, std::mt19937_64 & rng) {
+        ++seen;
+        if (items.size() < capacity) {
+            items.push_back({line, packed});
+        } else if (capacity > 0) {
+            size_t j = rng() % seen;
+            if (j < capacity)
+                items[j] = {line, packed};
+        }
+    }
+};
+
+void quicksampler_check(char const * file_name, sat::solver & solver, double timeout, unsigned num_threads) {
     std::string s(file_name);
     s += ".samples";
-    std::ifstream ifs(s);
+    int fd = open(s.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::cerr << "(error \"failed to open file '" << s << "'\")" << std::endl;
+        exit(ERR_OPEN_FILE);
+    }
+    size_t size = st.st_size;
+    char const * data = nullptr;
+    if (size > 0) {
+        data = static_cast<char const *>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+        if (data == MAP_FAILED) {
+            std::cerr << "(error \"failed to map file '" << s << "'\")" << std::endl;
+            exit(ERR_OPEN_FILE);
+        }
+        madvise(const_cast<char *>(data), size, MADV_SEQUENTIAL);
+    }
+    close(fd);
 
     int samples = 0;
     int valid[7] = {0};
@@ -237,93 +445,133 @@ void quicksampler_check(char const * file_name, sat::solver & solver, double tim
     int total[7] = {0};
     struct timespec initial;
     clock_gettime(CLOCK_REALTIME, &initial);
-    srand(initial.tv_sec);
+    std::mt19937_64 rng(initial.tv_sec);
+
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
 
-    int count = 0;
-    int steps = 0;
     p = gparams::get_module("sat");
     p.set_bool("produce_models", true);
-    for (std::string line; std::getline(ifs, line); ) {
-        ++count;
-        check_sample(solver, line);
-        if (count == 5) {
-            clock_gettime(CLOCK_REALTIME, &initial);
-            steps = 0;
+    std::vector<check_worker *> workers;
+    for (unsigned t = 0; t < num_threads; ++t)
+        workers.push_back(alloc(check_worker, solver));
+    clause_table clauses;
+    printf("Clauses %u, open %u\n", clauses.num_clauses(), clauses.num_open);
+
+    // Time the checks of the first lines, after a few to warm up, to size
+    // the random subset checked within the timeout.
+    int count = 0;
+    int steps = 0;
+    int nmut;
+    std::string packed;
+    for (size_t pos = 0; pos < size && count < 10; ) {
+        char const * end = static_cast<char const *>(memchr(data + pos, '\n', size - pos));
+        size_t n = (end ? end - data : size) - pos;
+        if (parse_line(data + pos, n, nmut, packed)) {
+            ++count;
+            std::string const * one = &packed;
+            bool result;
+            check_batch(*workers[0], clauses, &one, &result, 1);
+            if (count == 5) {
+                clock_gettime(CLOCK_REALTIME, &initial);
+                steps = 0;
+            }
+            ++steps;
         }
-        ++steps;
-        if (count == 10) break;
+        pos += n + 1;
     }
+    workers[0]->solver_time = 0.0;
+    workers[0]->calls = 0;
+    workers[0]->evaluated = 0;
     struct timespec current;
     clock_gettime(CLOCK_REALTIME, &current);
-    double step = duration(&initial, &current) / steps;
-    printf("Step %f s\n", step);
+    // The threads share the time budget.
+    double step = steps ? duration(&initial, &current) / steps / num_threads : 0.0;
+    printf("Step %f s, %u threads\n", step, num_threads);
+
+    // One pass over the file keeps a uniform subset of all lines that can be
+    // checked within the timeout, and at least 20 lines (or all of them) of
+    // every mutation count. Memory is bounded by the size of the subsets.
+    size_t budget = static_cast<size_t>(-1);
+    if (timeout != 0.0 && step > 0.0 && timeout / step < static_cast<double>(budget))
+        budget = std::max<size_t>(1, static_cast<size_t>(timeout / step));
+    reservoir uniform(budget);
+    reservoir least[7];
+    for (int i = 0; i < 7; ++i)
+        least[i] = reservoir(20);
 
-    ifs.clear();
-    ifs.seekg(0, std::ios::beg);
+    clock_gettime(CLOCK_REALTIME, &initial);
 
     count = 0;
-    for (std::string line; std::getline(ifs, line); ) {
-        ++count;
-        int nmut = line[0] - '0';
-        ++total[nmut];
+    for (size_t pos = 0; pos < size; ) {
+        char const * end = static_cast<char const *>(memchr(data + pos, '\n', size - pos));
+        size_t n = (end ? end - data : size) - pos;
+        if (parse_line(data + pos, n, nmut, packed) && nmut < 7) {
+            ++count;
+            ++total[nmut];
+            // The mutation count is stored with the sample as its last byte.
+            packed.push_back(static_cast<char>(nmut));
+            uniform.offer(count, packed, rng);
+            least[nmut].offer(count, packed, rng);
+        }
+        pos += n + 1;
     }
-
-    double probability = 1.0;
-
-    if (timeout != 0.0 && timeout / step < count) {
-        probability = (timeout / step) / count;
+    if (data)
+        munmap(const_cast<char *>(data), size);
+    printf("Lines %d, checking up to %zu\n", count, uniform.items.size());
+
+    // Only samples not seen before are checked, in parallel, and the tally
+    // comes last. c counts the lines of the uniform subset.
+    std::vector<std::pair<int, struct cell *>> picked;
+    std::vector<std::pair<std::string const *, struct cell *>> pending;
+    auto pick = [&](std::string & item, bool counted) {
+        int m = item.back();
+        item.pop_back();
+        auto search = hist.find(item);
+        if (search == hist.end()) {
+            struct cell mycell;
+            mycell.c = 0;
+            mycell.v = false;
+            search = hist.insert({item, mycell}).first;
+            pending.push_back({&search->first, &search->second});
+        }
+        if (counted)
+            ++search->second.c;
+        picked.push_back({m, &search->second});
+    };
+    std::unordered_set<size_t> lines;
+    for (auto & item : uniform.items) {
+        lines.insert(item.first);
+        pick(item.second, true);
     }
-    printf("Probability %f\n", probability);
-
-    double prob[7] = {0.0};
+    uniform.items.clear();
     for (int i = 0; i < 7; ++i) {
-        int min = total[i] < 20 ? total[i] : 20;
-        if (total[i] * probability < min) {
-            prob[i] = (double)min / (double)total[i];
-            printf("prob[%d] = %f\n", i, prob[i]);
-        }
+        // Mutation counts too rare for the uniform subset to show.
+        if (static_cast<double>(total[i]) * uniform.capacity / std::max(count, 1) >= least[i].items.size())
+            continue;
+        for (auto & item : least[i].items)
+            if (lines.find(item.first) == lines.end())
+                pick(item.second, false);
     }
+    check_parallel(pending, workers, clauses);
 
+    double solver_time = 0.0;
     int calls = 0;
-
-    ifs.clear();
-    ifs.seekg(0, std::ios::beg);
-
-    clock_gettime(CLOCK_REALTIME, &initial);
-
-    for (std::string line; std::getline(ifs, line); ) {
-        int nmut = line[0] - '0';
-        bool run1 = rand() <= probability * RAND_MAX;
-        bool run2 = false;
-        if (prob[nmut])
-            run2 = rand() <= prob[nmut] * RAND_MAX;
-
-        bool result;
-        if (run1 || run2) {
-            auto search = hist.find(line.substr(3));
-            if (search != hist.end()) {
-                result = search->second.v;
-                if (run1) {
-                    ++search->second.c;
-                }
-            } else {
-                result = check_sample(solver, line);
-                calls += 1;
-                struct cell mycell;
-                mycell.c = run1? 1 : 0;
-                mycell.v = result;
-                hist.insert({line.substr(3), mycell});
-            }
-
-            if (result) {
-                ++valid[nmut];
-            } else {
-                ++invalid[nmut];
-            }
-            ++samples;
+    int evaluated = 0;
+    for (check_worker * w : workers) {
+        solver_time += w->solver_time;
+        calls += w->calls;
+        evaluated += w->evaluated;
+        dealloc(w);
+    }
+    for (auto const & it : picked) {
+        if (it.second->v) {
+            ++valid[it.first];
+        } else {
+            ++invalid[it.first];
         }
+        ++samples;
     }
-    ifs.close();
     printf("Mutations\n");
     double all_v = 0.0;
     int all_t = 0;
@@ -367,22 +615,30 @@ void quicksampler_check(char const * file_name, sat::solver & solver, double tim
     printf("Solver %f s\n", solver_time);
     printf("Checked %d\n", samples);
     printf("Calls %d\n", calls);
+    printf("Evaluated %d\n", evaluated);
 
     std::string o(file_name);
     o += ".samples.valid";
-    std::ofstream ofs(o);
+    std::ofstream ofs(o, std::ios::binary);
+    std::string buffer;
     for (const auto& it : hist) {
         if (it.second.v) {
-            const char * sol = it.first.c_str();
-            for (int lit : indsup) {
-                if (*sol == '0')
-                    ofs << '-';
-                ofs << lit << ' ';
-                ++sol;
+            for (unsigned k = 0; k < indsup.size(); ++k) {
+                if (!sample_bit(it.first, k))
+                    buffer += '-';
+                buffer += std::to_string(indsup[k]);
+                buffer += ' ';
+            }
+            buffer += "0:";
+            buffer += std::to_string(it.second.c);
+            buffer += '\n';
+            if (buffer.size() >= (1 << 20)) {
+                ofs.write(buffer.data(), buffer.size());
+                buffer.clear();
             }
-            ofs << "0:" << it.second.c << '\n';
         }
     }
+    ofs.write(buffer.data(), buffer.size());
     ofs.close();
     exit(0);
 }
@@ -412,7 +668,8 @@ unsigned read_dimacs(char const * file_name) {
 
     if (p.get_bool("quicksampler_check", false)) {
         double timeout = p.get_double("quicksampler_check.timeout", 3600.0);
-        quicksampler_check(file_name, solver, timeout);
+        unsigned threads = p.get_uint("quicksampler_check.threads", 0);
+        quicksampler_check(file_name, solver, timeout, threads);
     }
     
     lbool r;
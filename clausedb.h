@@ -0,0 +1,171 @@
+#ifndef QUICKSAMPLER_CLAUSEDB_H
+#define QUICKSAMPLER_CLAUSEDB_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "dimacs.h"
+#include "sample.h"
+
+// The clauses of a formula in a compact form for cheap in-process checks.
+// Literals are encoded as 2*v for v and 2*v+1 for its negation. Duplicate
+// literals are merged and tautologies dropped; clause k is
+// lits[start[k]] .. lits[start[k+1]-1], and occurs[l] lists the clauses
+// containing literal l.
+class ClauseDB {
+public:
+    int nvars = 0;
+    std::vector<int> lits;
+    std::vector<uint32_t> start;
+    std::vector<std::vector<uint32_t>> occurs;
+    // The variable at each position of the independent support, or 0 where
+    // the support lists something that is not a variable.
+    std::vector<int> ind;
+    bool has_empty = false;
+
+    explicit ClauseDB(const Formula & f) : start(1, 0) {
+        nvars = f.max_var;
+        for (int v : f.ind)
+            if (v > nvars)
+                nvars = v;
+        for (int v : f.ind)
+            ind.push_back(v > 0 ? v : 0);
+        lits.reserve(f.lits.size());
+        std::vector<int> c;
+        for (size_t k = 0; k < f.num_clauses(); ++k) {
+            c.clear();
+            for (const int * l = f.clause_begin(k); l != f.clause_end(k); ++l)
+                c.push_back(2 * abs(*l) + (*l < 0));
+            std::sort(c.begin(), c.end());
+            c.erase(std::unique(c.begin(), c.end()), c.end());
+            bool tautology = false;
+            for (size_t i = 1; i < c.size(); ++i)
+                if (c[i] == (c[i - 1] ^ 1))
+                    tautology = true;
+            if (tautology)
+                continue;
+            if (c.empty())
+                has_empty = true;
+            lits.insert(lits.end(), c.begin(), c.end());
+            start.push_back(lits.size());
+        }
+        occurs.resize(2 * (nvars + 1));
+        for (uint32_t k = 0; k + 1 < start.size(); ++k)
+            for (uint32_t i = start[k]; i < start[k + 1]; ++i)
+                occurs[lits[i]].push_back(k);
+    }
+
+    size_t num_clauses() const { return start.size() - 1; }
+    size_t size(uint32_t k) const { return start[k + 1] - start[k]; }
+};
+
+// Unit propagation over a ClauseDB with two watched literals. After the
+// root-level units, check() assigns the independent variables from a sample
+// and propagates; a conflict proves the sample cannot be extended to a model
+// of the formula. No conflict proves nothing unless propagation assigned
+// every variable, but on formulas where the independent support determines
+// the rest it usually does. Each thread needs its own Propagator.
+class Propagator {
+    const ClauseDB & db;
+    std::vector<int> lits;
+    std::vector<std::vector<uint32_t>> watches;
+    std::vector<signed char> vals;
+    std::vector<int> trail;
+    size_t root = 0;
+    bool root_conflict = false;
+
+public:
+    explicit Propagator(const ClauseDB & db) : db(db), lits(db.lits), watches(2 * (db.nvars + 1)), vals(2 * (db.nvars + 1), 0) {
+        root_conflict = db.has_empty;
+        for (uint32_t k = 0; k < db.num_clauses(); ++k) {
+            if (db.size(k) == 1) {
+                if (!assign(lits[db.start[k]]))
+                    root_conflict = true;
+            } else if (db.size(k) > 1) {
+                watches[lits[db.start[k]]].push_back(k);
+                watches[lits[db.start[k] + 1]].push_back(k);
+            }
+        }
+        if (!propagate(0))
+            root_conflict = true;
+        root = trail.size();
+    }
+
+    // Returns false if assigning the independent support from s leads to a
+    // conflict.
+    bool check(const Sample & s) {
+        if (root_conflict)
+            return false;
+        bool ok = true;
+        for (size_t i = 0; i < db.ind.size() && ok; ++i)
+            if (db.ind[i])
+                ok = assign(2 * db.ind[i] + !s.get(i));
+        if (ok)
+            ok = propagate(root);
+        undo();
+        return ok;
+    }
+
+private:
+    bool assign(int lit) {
+        if (vals[lit] != 0)
+            return vals[lit] > 0;
+        vals[lit] = 1;
+        vals[lit ^ 1] = -1;
+        trail.push_back(lit);
+        return true;
+    }
+
+    void undo() {
+        for (size_t k = root; k < trail.size(); ++k) {
+            vals[trail[k]] = 0;
+            vals[trail[k] ^ 1] = 0;
+        }
+        trail.resize(root);
+    }
+
+    bool propagate(size_t head) {
+        while (head < trail.size()) {
+            int false_lit = trail[head++] ^ 1;
+            std::vector<uint32_t> & ws = watches[false_lit];
+            size_t i = 0, j = 0;
+            bool conflict = false;
+            while (i < ws.size()) {
+                uint32_t k = ws[i++];
+                int * c = &lits[db.start[k]];
+                int n = db.size(k);
+                if (c[0] == false_lit)
+                    std::swap(c[0], c[1]);
+                if (vals[c[0]] > 0) {
+                    ws[j++] = k;
+                    continue;
+                }
+                bool moved = false;
+                for (int m = 2; m < n; ++m) {
+                    if (vals[c[m]] >= 0) {
+                        std::swap(c[1], c[m]);
+                        watches[c[1]].push_back(k);
+                        moved = true;
+                        break;
+                    }
+                }
+                if (moved)
+                    continue;
+                ws[j++] = k;
+                if (!assign(c[0])) {
+                    conflict = true;
+                    while (i < ws.size())
+                        ws[j++] = ws[i++];
+                }
+            }
+            ws.resize(j);
+            if (conflict)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
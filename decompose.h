@@ -0,0 +1,347 @@
+#ifndef QUICKSAMPLER_DECOMPOSE_H
+#define QUICKSAMPLER_DECOMPOSE_H
+
+#include <stdlib.h>
+#include <z3++.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "backend.h"
+#include "clausedb.h"
+#include "dimacs.h"
+#include "preprocess.h"
+#include "sample.h"
+#include "vartable.h"
+
+// A part of the formula that shares no variable with the rest. Its variables
+// are renumbered from 1, and its support lists them in the order of the
+// sampled support, at the given positions.
+struct Component {
+    Formula formula;
+    std::vector<size_t> positions;
+    // For -f; null otherwise.
+    std::unique_ptr<ClauseDB> clauses;
+    // Every projected model, when the component was small enough to
+    // enumerate; such components are not sampled.
+    std::vector<Sample> models;
+    bool enumerated = false;
+};
+
+// Splits a formula into the connected components of its variable graph, two
+// variables being adjacent when they share a clause. Only components with
+// support variables are kept: the others cannot change which projections are
+// models, as long as they are satisfiable, which is checked once. Components
+// with at most enumerate_max support variables have all their projected
+// models listed up front, within the deadline.
+class Decomposer {
+public:
+    enum { enumerate_max = 8 };
+
+    static void split(const Formula & f, std::vector<Component> & parts, double deadline) {
+        int nvars = f.max_var;
+        for (int v : f.ind)
+            if (v > nvars)
+                nvars = v;
+        std::vector<int> parent(nvars + 1);
+        std::iota(parent.begin(), parent.end(), 0);
+        for (size_t k = 0; k < f.num_clauses(); ++k)
+            for (const int * l = f.clause_begin(k); l + 1 < f.clause_end(k); ++l)
+                unite(parent, abs(l[0]), abs(l[1]));
+
+        // Components in the order of their first support variable; an entry
+        // of the support that is not a variable is a component of its own.
+        std::vector<long> part_of_root(nvars + 1, -1);
+        std::vector<size_t> part_of_position(f.ind.size());
+        parts.clear();
+        for (size_t i = 0; i < f.ind.size(); ++i) {
+            int v = f.ind[i];
+            if (v > 0 && part_of_root[find(parent, v)] >= 0) {
+                part_of_position[i] = part_of_root[find(parent, v)];
+                continue;
+            }
+            part_of_position[i] = parts.size();
+            if (v > 0)
+                part_of_root[find(parent, v)] = parts.size();
+            parts.emplace_back();
+        }
+        // An empty clause belongs to no component.
+        Formula rest;
+        bool keep_rest = false;
+        for (size_t k = 0; k < f.num_clauses(); ++k) {
+            long p = -1;
+            if (f.clause_begin(k) == f.clause_end(k))
+                keep_rest = true;
+            else
+                p = part_of_root[find(parent, abs(*f.clause_begin(k)))];
+            Formula & out = p >= 0 ? parts[p].formula : rest;
+            out.lits.insert(out.lits.end(), f.clause_begin(k), f.clause_end(k));
+            out.start.push_back(out.lits.size());
+        }
+        for (size_t i = 0; i < f.ind.size(); ++i) {
+            parts[part_of_position[i]].formula.ind.push_back(f.ind[i]);
+            parts[part_of_position[i]].positions.push_back(i);
+        }
+        for (Component & c : parts)
+            renumber(c.formula);
+
+        // The clauses outside every component are dropped if they have a
+        // model, and otherwise kept with the first component, whose solvers
+        // will then report that there is no solution.
+        renumber(rest);
+        if (rest.num_clauses() > 0 && !keep_rest && solve(rest, deadline) != z3::sat)
+            keep_rest = true;
+        if (parts.empty())
+            return;
+        if (keep_rest)
+            merge(parts[0].formula, rest);
+
+        // A component without models is left to the workers for the same
+        // reason.
+        size_t largest = 0;
+        for (size_t p = 0; p < parts.size(); ++p) {
+            if (parts[p].formula.ind.size() > parts[largest].formula.ind.size())
+                largest = p;
+            if (parts[p].formula.ind.size() <= enumerate_max && !(keep_rest && p == 0))
+                parts[p].enumerated = enumerate(parts[p].formula, parts[p].models, deadline) && !parts[p].models.empty();
+        }
+        // At least one component is left to the workers.
+        bool sampled = false;
+        for (Component & c : parts)
+            sampled = sampled || !c.enumerated;
+        if (!sampled) {
+            parts[largest].enumerated = false;
+            parts[largest].models.clear();
+        }
+    }
+
+private:
+    static int find(std::vector<int> & parent, int v) {
+        while (parent[v] != v) {
+            parent[v] = parent[parent[v]];
+            v = parent[v];
+        }
+        return v;
+    }
+
+    static void unite(std::vector<int> & parent, int a, int b) {
+        a = find(parent, a);
+        b = find(parent, b);
+        if (a != b)
+            parent[a] = b;
+    }
+
+    // Numbers the variables of f from 1 in order of appearance, support
+    // first, so each component's solvers only create its own variables.
+    static void renumber(Formula & f) {
+        std::unordered_map<int, int> id;
+        auto map = [&](int v) {
+            auto it = id.find(v);
+            if (it != id.end())
+                return it->second;
+            int n = id.size() + 1;
+            id[v] = n;
+            return n;
+        };
+        for (int & v : f.ind)
+            v = v > 0 ? map(v) : v;
+        for (int & l : f.lits)
+            l = l > 0 ? map(l) : -map(-l);
+        f.max_var = id.size();
+    }
+
+    static void merge(Formula & into, const Formula & from) {
+        int shift = into.max_var;
+        for (size_t k = 0; k < from.num_clauses(); ++k) {
+            for (const int * l = from.clause_begin(k); l != from.clause_end(k); ++l)
+                into.lits.push_back(*l > 0 ? *l + shift : *l - shift);
+            into.start.push_back(into.lits.size());
+        }
+        into.max_var += from.max_var;
+    }
+
+    static z3::check_result solve(const Formula & f, double deadline) {
+        z3::context c;
+        z3::solver s(c, "QF_FD");
+        VarTable vars(c);
+        vars.init(f.max_var, f.ind);
+        add_clauses(c, vars, f, s);
+        return check(c, s, deadline);
+    }
+
+    static z3::check_result check(z3::context & c, z3::solver & s, double deadline) {
+        double left = deadline - Preprocessor::now();
+        if (left <= 0)
+            return z3::unknown;
+        z3::params p(c);
+        p.set("timeout", (unsigned)std::min(left * 1000.0 + 1.0, 4.0e9));
+        s.set(p);
+        return s.check();
+    }
+
+    // Lists the projections of every model by blocking each one found.
+    // Returns false if that did not finish by the deadline.
+    static bool enumerate(const Formula & f, std::vector<Sample> & models, double deadline) {
+        z3::context c;
+        z3::solver s(c, "QF_FD");
+        VarTable vars(c);
+        vars.init(f.max_var, f.ind);
+        add_clauses(c, vars, f, s);
+        Sample m;
+        while (true) {
+            z3::check_result r = check(c, s, deadline);
+            if (r == z3::unsat)
+                return true;
+            if (r != z3::sat) {
+                models.clear();
+                return false;
+            }
+            vars.extract(s.get_model(), m);
+            models.push_back(m);
+            z3::expr_vector block(c);
+            for (size_t i = 0; i < m.size(); ++i)
+                block.push_back(vars.ind_lit(i, !m.get(i)));
+            s.add(mk_or(block));
+        }
+    }
+};
+
+// Keeps the distinct samples found for each component, and builds samples of
+// the whole support from them. Each new sample of a component is joined with
+// every choice of samples of the other components when there are at most
+// compose_max such choices, and with compose_max random choices otherwise.
+// Nothing is built until every component has a sample. A component keeps at
+// most pool_max samples, a uniform random subset of those found (reservoir
+// sampling); a sample that was dropped counts as new if it is found again.
+// Shared by all workers.
+class Composer {
+    struct Pool {
+        std::vector<Sample> samples;
+        std::vector<int> depths;
+        std::unordered_set<Sample, SampleHash> known;
+        // Distinct samples offered to the pool, kept or not.
+        size_t seen = 0;
+    };
+
+    const std::vector<Component> & parts;
+    size_t nsupport;
+    std::vector<Pool> pools;
+    std::mt19937_64 rng;
+    std::mutex m;
+
+public:
+    enum { compose_max = 1024, pool_max = 1 << 16 };
+
+    // The samples built by one add(), owned by the caller so that their
+    // buffers are reused.
+    struct Batch {
+        std::vector<Sample> samples;
+        std::vector<int> depths;
+        size_t size = 0;
+    };
+
+    Composer(const std::vector<Component> & parts, size_t nsupport, unsigned seed) : parts(parts), nsupport(nsupport), pools(parts.size()), rng(seed) {
+        for (size_t p = 0; p < parts.size(); ++p)
+            for (const Sample & s : parts[p].models)
+                add_model(p, s, 0);
+    }
+
+    // Returns false if s was already known for the component. The depth of a
+    // composed sample is the largest depth of its parts. The samples are
+    // built under the lock into batch, and passed to emit after it is
+    // released, so workers do not wait on each other's output.
+    template <typename Emit>
+    bool add(size_t part, const Sample & s, int depth, Batch & batch, Emit emit) {
+        batch.size = 0;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if (!add_model(part, s, depth))
+                return false;
+            build(part, s, depth, batch);
+        }
+        for (size_t k = 0; k < batch.size; ++k)
+            emit(batch.samples[k], batch.depths[k]);
+        return true;
+    }
+
+private:
+    bool add_model(size_t part, const Sample & s, int depth) {
+        Pool & pool = pools[part];
+        if (pool.known.find(s) != pool.known.end())
+            return false;
+        pool.seen += 1;
+        if (pool.samples.size() < pool_max) {
+            pool.known.insert(s);
+            pool.samples.push_back(s);
+            pool.depths.push_back(depth);
+            return true;
+        }
+        size_t k = rng() % pool.seen;
+        if (k < pool_max) {
+            pool.known.erase(pool.samples[k]);
+            pool.known.insert(s);
+            pool.samples[k] = s;
+            pool.depths[k] = depth;
+        }
+        return true;
+    }
+
+    void build(size_t part, const Sample & s, int depth, Batch & batch) {
+        double choices = 1;
+        for (size_t p = 0; p < pools.size(); ++p)
+            if (p != part)
+                choices *= pools[p].samples.size();
+        if (choices == 0)
+            return;
+        std::vector<size_t> pick(pools.size(), 0);
+        if (choices <= compose_max) {
+            // Every choice, in mixed-radix order.
+            while (true) {
+                compose(part, s, depth, pick, batch);
+                size_t p = 0;
+                for (; p < pools.size(); ++p) {
+                    if (p == part)
+                        continue;
+                    if (++pick[p] < pools[p].samples.size())
+                        break;
+                    pick[p] = 0;
+                }
+                if (p == pools.size())
+                    break;
+            }
+        } else {
+            for (int k = 0; k < compose_max; ++k) {
+                for (size_t p = 0; p < pools.size(); ++p)
+                    if (p != part)
+                        pick[p] = rng() % pools[p].samples.size();
+                compose(part, s, depth, pick, batch);
+            }
+        }
+    }
+
+    // Joins s, a sample of part, with the picked samples of the others.
+    void compose(size_t part, const Sample & s, int depth, const std::vector<size_t> & pick, Batch & batch) {
+        if (batch.size == batch.samples.size()) {
+            batch.samples.emplace_back(nsupport);
+            batch.depths.push_back(0);
+        }
+        Sample & full = batch.samples[batch.size];
+        for (size_t p = 0; p < pools.size(); ++p) {
+            const Sample & ps = p == part ? s : pools[p].samples[pick[p]];
+            const std::vector<size_t> & positions = parts[p].positions;
+            for (size_t i = 0; i < positions.size(); ++i)
+                full.set(positions[i], ps.get(i));
+            if (p != part)
+                depth = std::max(depth, pools[p].depths[pick[p]]);
+        }
+        batch.depths[batch.size] = depth;
+        batch.size += 1;
+    }
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef QUICKSAMPLER_DEDUP_H
+#define QUICKSAMPLER_DEDUP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sample.h"
+
+// Remembers every sample written so far, across epochs and workers, by its
+// 128-bit hash. Shared between threads.
+class SampleFilter {
+public:
+    virtual ~SampleFilter() {}
+    // Returns true if s was not seen before. May be called concurrently.
+    virtual bool insert(const Sample & s) = 0;
+    virtual size_t memory() = 0;
+
+    static bool exists(const std::string & kind) {
+        return kind == "exact" || kind == "bloom" || kind == "none";
+    }
+
+    // Returns nullptr for "none". The memory cap only bounds "bloom".
+    static SampleFilter * create(const std::string & kind, size_t memory_cap);
+};
+
+// Exact up to hash collisions. Each shard is an open-addressing table of
+// hashes with its own lock, picked by the top bits of the hash so threads
+// rarely wait for each other. Tables are kept at most half full, so an entry
+// costs 32 to 64 bytes.
+class HashSampleSet : public SampleFilter {
+    struct Shard {
+        std::mutex m;
+        // Two words per slot; (0, 0) marks an empty slot.
+        std::vector<uint64_t> slots;
+        size_t count = 0;
+    };
+    std::vector<Shard> shards;
+
+public:
+    explicit HashSampleSet(size_t nshards = 64) : shards(nshards) {
+        for (Shard & shard : shards)
+            shard.slots.assign(2 * 1024, 0);
+    }
+
+    bool insert(const Sample & s) {
+        uint64_t lo, hi;
+        s.hash128(lo, hi);
+        if (lo == 0 && hi == 0)
+            lo = 1;
+        Shard & shard = shards[(hi >> 40) % shards.size()];
+        std::lock_guard<std::mutex> lock(shard.m);
+        if (2 * (shard.count + 1) > shard.slots.size() / 2)
+            grow(shard);
+        if (!place(shard.slots, lo, hi))
+            return false;
+        shard.count += 1;
+        return true;
+    }
+
+    size_t memory() {
+        size_t n = 0;
+        for (Shard & shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.m);
+            n += shard.slots.size() * sizeof(uint64_t);
+        }
+        return n;
+    }
+
+private:
+    // Linear probing; returns false if (lo, hi) was already there.
+    static bool place(std::vector<uint64_t> & slots, uint64_t lo, uint64_t hi) {
+        size_t mask = slots.size() / 2 - 1;
+        for (size_t k = lo & mask; ; k = (k + 1) & mask) {
+            uint64_t * slot = &slots[2 * k];
+            if (slot[0] == lo && slot[1] == hi)
+                return false;
+            if (slot[0] == 0 && slot[1] == 0) {
+                slot[0] = lo;
+                slot[1] = hi;
+                return true;
+            }
+        }
+    }
+
+    static void grow(Shard & shard) {
+        std::vector<uint64_t> bigger(2 * shard.slots.size(), 0);
+        for (size_t k = 0; k < shard.slots.size(); k += 2)
+            if (shard.slots[k] != 0 || shard.slots[k + 1] != 0)
+                place(bigger, shard.slots[k], shard.slots[k + 1]);
+        shard.slots.swap(bigger);
+    }
+};
+
+// A blocked Bloom filter of fixed size. Each sample sets one bit in each of
+// the eight words of a single 64-byte block, so an insert touches one cache
+// line. Bits are only ever set, with atomic ORs, so no locks are needed.
+// Once full enough, new samples are occasionally taken for duplicates and
+// dropped. A sample seen before is never accepted again, unless two threads
+// insert it at the same time: both can find its bits unset and accept it.
+class BloomSampleSet : public SampleFilter {
+    uint64_t * blocks = nullptr;
+    size_t nblocks;
+
+public:
+    explicit BloomSampleSet(size_t memory_cap) {
+        nblocks = memory_cap / 64;
+        if (nblocks == 0)
+            nblocks = 1;
+        if (posix_memalign((void **)&blocks, 64, nblocks * 64) != 0)
+            abort();
+        memset(blocks, 0, nblocks * 64);
+    }
+
+    ~BloomSampleSet() {
+        free(blocks);
+    }
+
+    bool insert(const Sample & s) {
+        uint64_t lo, hi;
+        s.hash128(lo, hi);
+        uint64_t * block = blocks + 8 * (size_t)(((unsigned __int128)lo * nblocks) >> 64);
+        bool fresh = false;
+        for (int w = 0; w < 8; ++w) {
+            uint64_t bit = (uint64_t)1 << ((hi >> (6 * w)) & 63);
+            if (!(__atomic_fetch_or(&block[w], bit, __ATOMIC_RELAXED) & bit))
+                fresh = true;
+        }
+        return fresh;
+    }
+
+    size_t memory() {
+        return nblocks * 64;
+    }
+};
+
+inline SampleFilter * SampleFilter::create(const std::string & kind, size_t memory_cap) {
+    if (kind == "bloom")
+        return new BloomSampleSet(memory_cap);
+    if (kind == "exact")
+        return new HashSampleSet();
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef QUICKSAMPLER_DIMACS_H
+#define QUICKSAMPLER_DIMACS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// A CNF formula with its independent support. Clause literals are stored
+// flattened: clause k is lits[start[k]] .. lits[start[k+1]-1].
+struct Formula {
+    int max_var = 0;
+    std::vector<int> ind;
+    std::vector<int> lits;
+    std::vector<size_t> start = std::vector<size_t>(1, 0);
+
+    size_t num_clauses() const { return start.size() - 1; }
+    const int * clause_begin(size_t k) const { return lits.data() + start[k]; }
+    const int * clause_end(size_t k) const { return lits.data() + start[k + 1]; }
+};
+
+// Reads DIMACS files through mmap, tokenizing newline-aligned chunks of the
+// file on separate threads.
+//
+// Lines starting with "c ind " list independent support variables; the first
+// occurrence of each non-zero value is kept, in order. Until the first such
+// variable is recorded, every clause variable counts as already seen, exactly
+// as parse_cnf() and check/dimacs.cpp always did. Without a "c ind " line the
+// support is every variable that occurs in a clause, in increasing order.
+// Other lines starting with 'c' or 'p' are skipped, and every other line
+// holds clauses terminated by 0 or by the end of the line.
+class DimacsLoader {
+    struct IndLine {
+        size_t clause;
+        std::vector<int> vars;
+    };
+
+    struct Chunk {
+        const char * begin;
+        const char * end;
+        int max_var = 0;
+        std::vector<int> lits;
+        std::vector<size_t> start;
+        std::vector<IndLine> ind_lines;
+    };
+
+public:
+    static bool load(const std::string & path, Formula & f, unsigned threads = 0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        size_t size = st.st_size;
+        const char * data = nullptr;
+        if (size > 0) {
+            void * p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                return false;
+            }
+            madvise(p, size, MADV_SEQUENTIAL);
+            data = (const char *)p;
+        }
+        close(fd);
+        parse(data, size, f, threads);
+        if (size > 0)
+            munmap((void *)data, size);
+        return true;
+    }
+
+    static void parse(const char * data, size_t size, Formula & f, unsigned threads = 0) {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        size_t min_chunk = 1 << 20;
+        if (size / min_chunk + 1 < threads)
+            threads = size / min_chunk + 1;
+
+        std::vector<Chunk> chunks(threads);
+        const char * end = data + size;
+        const char * pos = data;
+        for (unsigned t = 0; t < threads; ++t) {
+            chunks[t].begin = pos;
+            const char * split = t + 1 == threads ? end : data + size / threads * (t + 1);
+            if (split < pos)
+                split = pos;
+            while (split < end && *split != '\n')
+                ++split;
+            if (split < end)
+                ++split;
+            chunks[t].end = split;
+            pos = split;
+        }
+
+        if (threads == 1) {
+            parse_chunk(chunks[0]);
+        } else {
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; ++t)
+                workers.emplace_back(parse_chunk, std::ref(chunks[t]));
+            for (auto & w : workers)
+                w.join();
+        }
+        merge(chunks, f);
+    }
+
+private:
+    static bool is_space(char ch) {
+        return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\f';
+    }
+
+    // Parses one integer starting at p; returns false if there is none.
+    static bool parse_int(const char *& p, const char * end, int & v) {
+        bool neg = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            neg = *p == '-';
+            ++p;
+        }
+        if (p >= end || *p < '0' || *p > '9')
+            return false;
+        int val = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            val = val * 10 + (*p - '0');
+            ++p;
+        }
+        v = neg ? -val : val;
+        return true;
+    }
+
+    static void parse_chunk(Chunk & ch) {
+        const char * p = ch.begin;
+        const char * end = ch.end;
+        ch.lits.reserve((end - p) / 4);
+        ch.start.push_back(0);
+        while (p < end) {
+            if (*p == 'c') {
+                if (end - p >= 6 && memcmp(p, "c ind ", 6) == 0) {
+                    IndLine line;
+                    line.clause = ch.start.size() - 1;
+                    p += 6;
+                    while (p < end && *p != '\n') {
+                        int v;
+                        if (is_space(*p))
+                            ++p;
+                        else if (parse_int(p, end, v))
+                            line.vars.push_back(v);
+                        else
+                            break;
+                    }
+                    ch.ind_lines.push_back(line);
+                }
+            } else if (*p != 'p') {
+                while (p < end && *p != '\n') {
+                    int v;
+                    if (is_space(*p)) {
+                        ++p;
+                    } else if (parse_int(p, end, v)) {
+                        if (v == 0) {
+                            if (ch.lits.size() > ch.start.back())
+                                ch.start.push_back(ch.lits.size());
+                        } else {
+                            ch.lits.push_back(v);
+                            if (abs(v) > ch.max_var)
+                                ch.max_var = abs(v);
+                        }
+                    } else {
+                        break;
+                    }
+                }
+                if (ch.lits.size() > ch.start.back())
+                    ch.start.push_back(ch.lits.size());
+            }
+            while (p < end && *p != '\n')
+                ++p;
+            if (p < end)
+                ++p;
+        }
+    }
+
+    static void merge(std::vector<Chunk> & chunks, Formula & f) {
+        size_t nlits = 0;
+        size_t nclauses = 0;
+        for (const Chunk & ch : chunks) {
+            nlits += ch.lits.size();
+            nclauses += ch.start.size() - 1;
+            if (ch.max_var > f.max_var)
+                f.max_var = ch.max_var;
+        }
+        f.lits.clear();
+        f.lits.reserve(nlits);
+        f.start.assign(1, 0);
+        f.start.reserve(nclauses + 1);
+
+        std::unordered_set<int> indset;
+        bool has_ind = false;
+        size_t seen = 0;
+        for (Chunk & ch : chunks) {
+            size_t base_clause = f.start.size() - 1;
+            size_t base_lit = f.lits.size();
+            f.lits.insert(f.lits.end(), ch.lits.begin(), ch.lits.end());
+            for (size_t k = 1; k < ch.start.size(); ++k)
+                f.start.push_back(base_lit + ch.start[k]);
+            for (const IndLine & line : ch.ind_lines) {
+                if (!has_ind)
+                    seen = note_clause_vars(f, seen, base_clause + line.clause, indset);
+                for (int v : line.vars) {
+                    if (v && indset.find(v) == indset.end()) {
+                        indset.insert(v);
+                        f.ind.push_back(v);
+                        has_ind = true;
+                    }
+                }
+            }
+            std::vector<int>().swap(ch.lits);
+        }
+
+        if (!has_ind) {
+            std::vector<char> used(f.max_var + 1, 0);
+            for (int l : f.lits)
+                used[abs(l)] = 1;
+            for (int v = 0; v <= f.max_var; ++v)
+                if (used[v])
+                    f.ind.push_back(v);
+        }
+    }
+
+    static size_t note_clause_vars(const Formula & f, size_t from, size_t to, std::unordered_set<int> & indset) {
+        for (size_t i = f.start[from]; i < f.start[to]; ++i)
+            indset.insert(abs(f.lits[i]));
+        return to;
+    }
+};
+
+#endif
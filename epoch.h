@@ -0,0 +1,128 @@
+#ifndef QUICKSAMPLER_EPOCH_H
+#define QUICKSAMPLER_EPOCH_H
+
+#include <stddef.h>
+#include <deque>
+#include <unordered_set>
+#include <vector>
+
+#include "profiler.h"
+#include "sample.h"
+
+// The flips of one epoch and the mutations built from them. A mutation of
+// depth d is combined with every flip found after the last flip it
+// contains, giving mutations of depth d + 1. Mutations waiting for such
+// flips are ready; the others are idle until the next flip arrives.
+// Combinations are made lazily, lowest depth first, so an epoch can be
+// combined a slice at a time as its flips arrive.
+class Epoch {
+public:
+    // Combinations of more flips than this are not extended further.
+    enum { max_depth = 6 };
+
+    struct Mutation {
+        Sample sample;
+        int depth;
+        // The next flip to combine this mutation with.
+        size_t next;
+    };
+
+    size_t part;
+    Sample base;
+    std::vector<Sample> flips;
+    // The position in the support flipped for each flip, for -a.
+    std::vector<size_t> flip_vars;
+    std::unordered_set<Sample, SampleHash> flip_set;
+    std::vector<Mutation> mutations;
+    std::unordered_set<Sample, SampleHash> known;
+    std::vector<std::deque<size_t>> ready;
+    std::vector<std::vector<size_t>> idle;
+    // Candidates made so far, and bytes used by the mutations.
+    size_t generated = 0;
+    size_t memory = 0;
+    // Candidates made after each flip; the rest wait for the end of the
+    // flips.
+    size_t slice = 0;
+    Sample candidate;
+
+    // At most budget candidates are made, and at most memory_budget bytes of
+    // mutations are kept. Combination time goes to profile, if not null.
+    Epoch(size_t part, const Sample & base, size_t budget, size_t memory_budget, Profile * profile) : part(part), base(base), ready(max_depth), idle(max_depth), candidate(base.size()), budget(budget), memory_budget(memory_budget), profile(profile) {
+        slice = budget / (base.size() + 1) + 1;
+    }
+
+    // Records the model of a flip of the support position var. Returns
+    // false if the epoch had that model already.
+    bool add_flip(const Sample & s, size_t var) {
+        if (!flip_set.insert(s).second)
+            return false;
+        flips.push_back(s);
+        flip_vars.push_back(var);
+        for (int d = 1; d < max_depth; ++d) {
+            ready[d].insert(ready[d].end(), idle[d].begin(), idle[d].end());
+            idle[d].clear();
+        }
+        remember(s, 1, flips.size());
+        return true;
+    }
+
+    // Makes up to limit candidates into candidate, lowest depth first,
+    // within the budget, and none once the memory budget is used up. After
+    // each one, visit(fresh, depth, flip) is called with whether it was a new
+    // mutation, its depth and the index of the newest flip in it.
+    template <typename Visit>
+    void combine(size_t limit, Visit visit) {
+        size_t made = 0;
+        int d = 1;
+        while (made < limit && generated < budget && memory < memory_budget) {
+            while (d < max_depth && ready[d].empty())
+                ++d;
+            if (d == max_depth)
+                return;
+            size_t k = ready[d].front();
+            ready[d].pop_front();
+            while (mutations[k].next < flips.size() && made < limit && generated < budget && memory < memory_budget) {
+                size_t f = mutations[k].next++;
+                uint64_t start = Profile::ticks();
+                Sample::combine(base, mutations[k].sample, flips[f], candidate);
+                made += 1;
+                generated += 1;
+                bool fresh = remember(candidate, d + 1, f + 1);
+                if (profile)
+                    profile->record(Profile::COMBINE, Profile::ticks() - start);
+                visit(fresh, d + 1, f);
+            }
+            if (mutations[k].next < flips.size())
+                ready[d].push_front(k);
+            else
+                idle[d].push_back(k);
+        }
+    }
+
+private:
+    size_t budget;
+    size_t memory_budget;
+    Profile * profile;
+
+    // Adds s to the mutations. Returns false if it was there already, or if
+    // the memory budget is used up: a sample that cannot be kept could not
+    // be recognized when made again, so it is treated as seen.
+    bool remember(const Sample & s, int depth, size_t next) {
+        if (memory >= memory_budget || known.find(s) != known.end())
+            return false;
+        known.insert(s);
+        // The sample is stored twice, plus node and index overhead.
+        memory += 2 * s.nwords() * sizeof(uint64_t) + 96;
+        size_t k = mutations.size();
+        mutations.push_back(Mutation{s, depth, next});
+        if (depth >= max_depth)
+            return true;
+        if (next < flips.size())
+            ready[depth].push_back(k);
+        else
+            idle[depth].push_back(k);
+        return true;
+    }
+};
+
+#endif
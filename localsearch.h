@@ -0,0 +1,218 @@
+#ifndef QUICKSAMPLER_LOCALSEARCH_H
+#define QUICKSAMPLER_LOCALSEARCH_H
+
+#include <stdint.h>
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "clausedb.h"
+#include "sample.h"
+
+// WalkSAT over a ClauseDB. The assignment covers every variable; each
+// clause keeps its number of true literals and the xor of their variables,
+// which is the critical variable when only one is true, and each variable
+// the number of clauses it alone satisfies, its break count. Flipping a
+// variable updates these through the occurrence lists of its two literals.
+// A step picks a random unsatisfied clause and flips in it the variable of
+// lowest score, its break count plus one for support variables, so repairs
+// change the rest of the assignment first. Unless that score is 0, a random
+// variable of the clause is flipped instead with probability noise. Frozen
+// variables are never flipped by a step.
+class LocalSearch {
+    const ClauseDB & db;
+    std::vector<char> value;
+    std::vector<char> frozen;
+    std::vector<char> in_support;
+    std::vector<uint32_t> num_true;
+    std::vector<int> critical;
+    std::vector<uint32_t> breaks;
+    std::vector<uint32_t> unsat;
+    // Index of each clause in unsat; none when satisfied.
+    std::vector<uint32_t> unsat_pos;
+    std::mt19937 rng;
+    // Variables flipped since the last mark, for undo().
+    std::vector<int> log;
+
+    enum : uint32_t { none = 0xffffffff };
+
+public:
+    static constexpr double noise = 0.5;
+
+    LocalSearch(const ClauseDB & db, unsigned seed) : db(db), value(db.nvars + 1, 0), frozen(db.nvars + 1, 0), in_support(db.nvars + 1, 0), num_true(db.num_clauses(), 0), critical(db.num_clauses(), 0), breaks(db.nvars + 1, 0), unsat_pos(db.num_clauses(), none), rng(seed) {
+        for (int v : db.ind)
+            if (v)
+                in_support[v] = 1;
+        for (int v = 1; v <= db.nvars; ++v)
+            value[v] = rng() & 1;
+        for (uint32_t k = 0; k < db.num_clauses(); ++k) {
+            for (uint32_t i = db.start[k]; i < db.start[k + 1]; ++i) {
+                int l = db.lits[i];
+                if (value[l >> 1] != (l & 1)) {
+                    num_true[k] += 1;
+                    critical[k] ^= l >> 1;
+                }
+            }
+            if (num_true[k] == 0)
+                add_unsat(k);
+            else if (num_true[k] == 1)
+                breaks[critical[k]] += 1;
+        }
+    }
+
+    bool satisfied() const {
+        return unsat.empty();
+    }
+
+    bool get(int v) const {
+        return value[v];
+    }
+
+    void set(int v, bool b) {
+        if (value[v] != b)
+            move(v);
+    }
+
+    void freeze(int v, bool f) {
+        frozen[v] = f;
+    }
+
+    // Sets the support variables from s.
+    void assign(const Sample & s) {
+        for (size_t i = 0; i < db.ind.size(); ++i)
+            if (db.ind[i])
+                set(db.ind[i], s.get(i));
+    }
+
+    // The support variables; positions that are not variables are false.
+    void project(Sample & out) const {
+        out = Sample(db.ind.size());
+        for (size_t i = 0; i < db.ind.size(); ++i)
+            if (db.ind[i] && value[db.ind[i]])
+                out.set(i, true);
+    }
+
+    // Takes up to max_steps steps. Returns true once every clause is
+    // satisfied, false if the steps ran out or an unsatisfied clause has
+    // only frozen variables.
+    bool walk(size_t max_steps) {
+        for (size_t step = 0; step < max_steps && !unsat.empty(); ++step) {
+            uint32_t k = unsat[rng() % unsat.size()];
+            int best = 0;
+            uint32_t best_score = none;
+            int free = 0;
+            int ties = 0;
+            for (uint32_t i = db.start[k]; i < db.start[k + 1]; ++i) {
+                int v = db.lits[i] >> 1;
+                if (frozen[v])
+                    continue;
+                free += 1;
+                uint32_t score = breaks[v] + in_support[v];
+                if (score < best_score)
+                    ties = 0;
+                if (score <= best_score && rng() % ++ties == 0) {
+                    best = v;
+                    best_score = score;
+                }
+            }
+            if (free == 0)
+                return false;
+            if (best_score > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < noise) {
+                int pick = rng() % free;
+                for (uint32_t i = db.start[k]; i < db.start[k + 1]; ++i) {
+                    int v = db.lits[i] >> 1;
+                    if (!frozen[v] && pick-- == 0) {
+                        best = v;
+                        break;
+                    }
+                }
+            }
+            move(best);
+        }
+        return unsat.empty();
+    }
+
+    // Forgets the flips made so far; undo() reverts those made after.
+    void mark() {
+        log.clear();
+    }
+
+    void undo() {
+        for (size_t k = log.size(); k-- > 0;)
+            flip(log[k]);
+        log.clear();
+    }
+
+private:
+    void move(int v) {
+        flip(v);
+        log.push_back(v);
+    }
+
+    void flip(int v) {
+        int now_true = 2 * v + value[v];
+        value[v] = !value[v];
+        for (uint32_t k : db.occurs[now_true]) {
+            critical[k] ^= v;
+            uint32_t n = ++num_true[k];
+            if (n == 1) {
+                remove_unsat(k);
+                breaks[v] += 1;
+            } else if (n == 2) {
+                breaks[critical[k] ^ v] -= 1;
+            }
+        }
+        for (uint32_t k : db.occurs[now_true ^ 1]) {
+            critical[k] ^= v;
+            uint32_t n = --num_true[k];
+            if (n == 0) {
+                add_unsat(k);
+                breaks[v] -= 1;
+            } else if (n == 1) {
+                breaks[critical[k]] += 1;
+            }
+        }
+    }
+
+    void add_unsat(uint32_t k) {
+        unsat_pos[k] = unsat.size();
+        unsat.push_back(k);
+    }
+
+    void remove_unsat(uint32_t k) {
+        uint32_t p = unsat_pos[k];
+        unsat[p] = unsat.back();
+        unsat_pos[unsat[p]] = p;
+        unsat.pop_back();
+        unsat_pos[k] = none;
+    }
+};
+
+// How often local search repaired a flip, and the time spent searching and
+// in the flips passed to the solver, in ticks. Shared by the backends of all
+// workers.
+struct SearchStats {
+    std::atomic<uint64_t> attempts{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> search_ticks{0};
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> solver_ticks{0};
+
+    // The time saved is an estimate: the hits at the mean time of the flips
+    // the solver answered, less all the time spent searching. It is negative
+    // when searching cost more than it saved. The solver gets the harder
+    // flips, so the estimate is on the high side.
+    void print(double ticks_per_second) const {
+        uint64_t n = attempts;
+        double mean = calls > 0 ? (double)solver_ticks / calls : 0.0;
+        std::cout << "Local search: flips repaired " << hits << " of " << n;
+        if (n > 0)
+            std::cout << " (" << 100.0 * hits / n << "%)";
+        std::cout << '\n';
+        std::cout << "Local search time " << search_ticks / ticks_per_second << " s, estimated net solver time saved " << (hits * mean - (double)search_ticks) / ticks_per_second << " s\n";
+        std::cout.flush();
+    }
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef QUICKSAMPLER_METRICS_H
+#define QUICKSAMPLER_METRICS_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string>
+#include <vector>
+
+struct Metric {
+    const char * name;
+    const char * type;
+    const char * help;
+    double value;
+};
+
+// Writes snapshots of metrics as JSON lines or in the Prometheus text
+// format, to a file or to a Unix socket given as "unix:PATH".
+//
+// JSON lines are appended to a file, one object per snapshot. A Prometheus
+// file is replaced by each snapshot (written aside and renamed), as textfile
+// collectors expect. On a socket, every snapshot is sent on a new stream
+// connection, so a reader can come and go; snapshots nobody reads are lost.
+class MetricsWriter {
+    std::string path;
+    bool socket = false;
+    bool prometheus = false;
+    int fd = -1;
+
+public:
+    static bool format_exists(const std::string & format) {
+        return format == "json" || format == "prometheus";
+    }
+
+    ~MetricsWriter() {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    bool open(const std::string & destination, const std::string & format) {
+        prometheus = format == "prometheus";
+        if (destination.compare(0, 5, "unix:") == 0) {
+            socket = true;
+            path = destination.substr(5);
+            return path.size() < sizeof(((struct sockaddr_un *)0)->sun_path);
+        }
+        path = destination;
+        if (prometheus)
+            return true;
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        return fd >= 0;
+    }
+
+    void write(const std::vector<Metric> & metrics, double timestamp) {
+        std::string text = prometheus ? to_prometheus(metrics) : to_json(metrics, timestamp);
+        if (socket)
+            send(text);
+        else if (prometheus)
+            replace(text);
+        else
+            write_all(fd, text);
+    }
+
+    static std::string to_json(const std::vector<Metric> & metrics, double timestamp) {
+        std::string out = "{\"timestamp\":" + number(timestamp);
+        for (const Metric & m : metrics) {
+            out += ",\"";
+            out += m.name;
+            out += "\":";
+            out += number(m.value);
+        }
+        out += "}\n";
+        return out;
+    }
+
+    static std::string to_prometheus(const std::vector<Metric> & metrics) {
+        std::string out;
+        for (const Metric & m : metrics) {
+            out += std::string("# HELP quicksampler_") + m.name + " " + m.help + "\n";
+            out += std::string("# TYPE quicksampler_") + m.name + " " + m.type + "\n";
+            out += std::string("quicksampler_") + m.name + " " + number(m.value) + "\n";
+        }
+        return out;
+    }
+
+private:
+    static std::string number(double v) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.15g", v);
+        return buf;
+    }
+
+    // Sockets are written with MSG_NOSIGNAL: a reader that hangs up gives
+    // EPIPE, which drops the snapshot, instead of SIGPIPE killing the
+    // sampler.
+    static bool write_all(int fd, const std::string & text, bool to_socket = false) {
+        size_t done = 0;
+        while (done < text.size()) {
+            const char * data = text.data() + done;
+            size_t size = text.size() - done;
+            ssize_t w = to_socket ? ::send(fd, data, size, MSG_NOSIGNAL) : ::write(fd, data, size);
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            done += w;
+        }
+        return true;
+    }
+
+    void replace(const std::string & text) {
+        std::string tmp = path + ".tmp";
+        int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out < 0)
+            return;
+        bool ok = write_all(out, text);
+        ::close(out);
+        if (ok)
+            rename(tmp.c_str(), path.c_str());
+    }
+
+    void send(const std::string & text) {
+        int s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s < 0)
+            return;
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            write_all(s, text, true);
+        ::close(s);
+    }
+};
+
+#endif
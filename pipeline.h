@@ -0,0 +1,75 @@
+#ifndef QUICKSAMPLER_PIPELINE_H
+#define QUICKSAMPLER_PIPELINE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A bounded lock-free queue between exactly one producer thread and one
+// consumer thread. Slots are reused: push copies into the slot and pop swaps
+// it out, so once the queue has cycled, values that own buffers (such as
+// Sample) move through it without allocating.
+template <typename T>
+class SpscQueue {
+    std::vector<T> slots;
+    size_t mask;
+    // Next slot to pop, written by the consumer only; padded so the two
+    // indices do not share a cache line.
+    std::atomic<size_t> head{0};
+    char pad[64];
+    // Next slot to push, written by the producer only.
+    std::atomic<size_t> tail{0};
+
+public:
+    explicit SpscQueue(size_t capacity) {
+        size_t n = 1;
+        while (n < capacity)
+            n *= 2;
+        slots.resize(n);
+        mask = n - 1;
+    }
+
+    bool try_push(const T & value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size())
+            return false;
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T & out) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        std::swap(out, slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// Waits for a queue without a lock or condition variable: spins briefly,
+// then yields, then sleeps, so an idle stage costs little CPU.
+class Backoff {
+    unsigned rounds = 0;
+
+public:
+    void pause() {
+        rounds += 1;
+        if (rounds < 64)
+            return;
+        if (rounds < 128)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    void reset() {
+        rounds = 0;
+    }
+};
+
+#endif
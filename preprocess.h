@@ -0,0 +1,312 @@
+#ifndef QUICKSAMPLER_PREPROCESS_H
+#define QUICKSAMPLER_PREPROCESS_H
+
+#include <stdlib.h>
+#include <time.h>
+#include <z3++.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "backend.h"
+#include "clausedb.h"
+#include "dimacs.h"
+#include "sample.h"
+#include "vartable.h"
+
+// What preprocessing leaves: the formula over the free variables, the
+// positions in the support of its support variables, and the value of every
+// variable, with how each was fixed.
+struct Reduction {
+    Formula formula;
+    std::vector<int> free_positions;
+    std::vector<signed char> value;
+    uint64_t units = 0;
+    uint64_t pure = 0;
+    uint64_t backbone = 0;
+};
+
+// Fixes variables before sampling without changing the set of solutions
+// projected on the independent support. Root-level units are propagated; a
+// variable outside the support that occurs with one sign only is set to
+// that sign, which can only satisfy more clauses; and the backbone of the
+// support, the variables with the same value in every model, is found with
+// one plain SAT query per candidate. reduce() then writes the formula left
+// over the free variables, with only the free support variables as its
+// support.
+class Preprocessor {
+    const ClauseDB db;
+    const std::vector<int> support;
+    std::vector<char> in_support;
+    // Per clause: whether some literal is true, and how many are not false.
+    std::vector<char> satisfied;
+    std::vector<uint32_t> open;
+    // Per literal: the clauses not yet satisfied that contain it.
+    std::vector<uint32_t> occurrences;
+    std::vector<int> trail;
+    size_t propagated = 0;
+    bool conflict = false;
+
+public:
+    // Per variable: 1 true, -1 false, 0 free.
+    std::vector<signed char> value;
+    size_t units = 0;
+    size_t pure = 0;
+    size_t backbone = 0;
+    // False if the backbone search gave up on some variable.
+    bool complete = true;
+
+    explicit Preprocessor(const Formula & f) : db(f), support(f.ind), in_support(db.nvars + 1, 0), satisfied(db.num_clauses(), 0), open(db.num_clauses()), occurrences(2 * (db.nvars + 1), 0), value(db.nvars + 1, 0) {
+        for (int v : db.ind)
+            in_support[v] = 1;
+        for (uint32_t k = 0; k < db.num_clauses(); ++k) {
+            open[k] = db.size(k);
+            for (uint32_t i = db.start[k]; i < db.start[k + 1]; ++i)
+                occurrences[db.lits[i]] += 1;
+        }
+        conflict = db.has_empty;
+    }
+
+    // Propagates units and pure literals to a fixpoint. Returns false if the
+    // formula has no model.
+    bool simplify() {
+        for (uint32_t k = 0; k < db.num_clauses() && !conflict; ++k)
+            if (!satisfied[k] && open[k] == 1)
+                assign_unit(k);
+        while (!conflict) {
+            propagate();
+            if (conflict)
+                break;
+            // Variables without occurrences left are unconstrained, not pure.
+            bool found = false;
+            for (int v = 1; v <= db.nvars && !conflict; ++v) {
+                if (value[v] != 0 || in_support[v])
+                    continue;
+                size_t p = occurrences[2 * v];
+                size_t n = occurrences[2 * v + 1];
+                if ((p == 0) == (n == 0))
+                    continue;
+                assign(p > 0 ? 2 * v : 2 * v + 1);
+                pure += 1;
+                found = true;
+            }
+            if (!found)
+                break;
+        }
+        return !conflict;
+    }
+
+    // Finds the backbone of the free support variables with up to threads
+    // solvers, each taking the next undecided variable and assuming it takes
+    // the other value than in a first model. Every model found rules out all
+    // variables whose value differs from the first one. Queries stop at the
+    // deadline, in seconds of CLOCK_MONOTONIC; the variables left undecided
+    // are simply not fixed. Backbone values are propagated with simplify().
+    void find_backbone(unsigned threads, double deadline) {
+        if (conflict)
+            return;
+        Formula f;
+        std::vector<int> free_positions;
+        reduce(f, free_positions);
+        size_t n = f.ind.size();
+        if (n == 0)
+            return;
+        Sample first;
+        {
+            Solver s(f);
+            z3::check_result r = s.check(nullptr, 0, deadline);
+            if (r != z3::sat) {
+                complete = r == z3::unsat;
+                return;
+            }
+            s.vars.extract(s.s.get_model(), first);
+        }
+        // 0 undecided, 1 free, 2 backbone.
+        std::vector<std::atomic<char>> state(n);
+        for (auto & x : state)
+            x = 0;
+        std::atomic<size_t> next{0};
+        std::atomic<bool> gave_up{false};
+        auto work = [&] {
+            Solver s(f);
+            Sample model;
+            for (size_t i = next++; i < n; i = next++) {
+                if (state[i] != 0)
+                    continue;
+                z3::expr flipped = s.vars.ind_lit(i, !first.get(i));
+                z3::check_result r = s.check(&flipped, 1, deadline);
+                if (r == z3::sat) {
+                    s.vars.extract(s.s.get_model(), model);
+                    for (size_t j = 0; j < n; ++j)
+                        if (model.get(j) != first.get(j))
+                            state[j] = 1;
+                } else if (r == z3::unsat) {
+                    state[i] = 2;
+                    s.s.add(s.vars.ind_lit(i, first.get(i)));
+                } else {
+                    gave_up = true;
+                    if (now() >= deadline)
+                        return;
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; ++t)
+            workers.emplace_back(work);
+        work();
+        for (auto & t : workers)
+            t.join();
+        complete = !gave_up && next >= n;
+        for (size_t i = 0; i < n; ++i) {
+            int v = f.ind[i];
+            if (state[i] == 2 && v > 0 && value[v] == 0) {
+                assign(first.get(i) ? 2 * v : 2 * v + 1);
+                backbone += 1;
+            }
+        }
+        simplify();
+    }
+
+    // Writes the clauses left over the free variables, and the positions in
+    // the support of the free support variables. An unsatisfiable formula is
+    // reduced to the empty clause.
+    void reduce(Formula & out, std::vector<int> & free_positions) const {
+        out = Formula();
+        out.max_var = db.nvars;
+        free_positions.clear();
+        for (size_t i = 0; i < db.ind.size(); ++i) {
+            int v = db.ind[i];
+            if (v == 0 || value[v] == 0) {
+                out.ind.push_back(support[i]);
+                free_positions.push_back(i);
+            }
+        }
+        if (conflict) {
+            out.start.push_back(0);
+            return;
+        }
+        for (uint32_t k = 0; k < db.num_clauses(); ++k) {
+            if (satisfied[k])
+                continue;
+            for (uint32_t i = db.start[k]; i < db.start[k + 1]; ++i) {
+                int l = db.lits[i];
+                if (value[l >> 1] == 0)
+                    out.lits.push_back(l & 1 ? -(l >> 1) : l >> 1);
+            }
+            out.start.push_back(out.lits.size());
+        }
+    }
+
+    void reduce(Reduction & out) const {
+        reduce(out.formula, out.free_positions);
+        out.value = value;
+        out.units = units;
+        out.pure = pure;
+        out.backbone = backbone;
+    }
+
+    static double now() {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + 1.0e-9 * t.tv_nsec;
+    }
+
+private:
+    struct Solver {
+        z3::context c;
+        z3::solver s;
+        VarTable vars;
+
+        explicit Solver(const Formula & f) : s(c, "QF_FD"), vars(c) {
+            vars.init(f.max_var, f.ind);
+            add_clauses(c, vars, f, s);
+        }
+
+        z3::check_result check(z3::expr * assumptions, unsigned n, double deadline) {
+            double left = deadline - now();
+            if (left <= 0)
+                return z3::unknown;
+            z3::params p(c);
+            p.set("timeout", (unsigned)std::min(left * 1000.0 + 1.0, 4.0e9));
+            s.set(p);
+            return s.check(n, assumptions);
+        }
+    };
+
+    void assign(int l) {
+        value[l >> 1] = l & 1 ? -1 : 1;
+        trail.push_back(l);
+    }
+
+    void assign_unit(uint32_t k) {
+        for (uint32_t i = db.start[k]; i < db.start[k + 1]; ++i) {
+            int l = db.lits[i];
+            if (value[l >> 1] == 0) {
+                assign(l);
+                units += 1;
+                return;
+            }
+        }
+    }
+
+    void propagate() {
+        while (propagated < trail.size() && !conflict) {
+            int l = trail[propagated++];
+            for (uint32_t k : db.occurs[l]) {
+                if (satisfied[k])
+                    continue;
+                satisfied[k] = 1;
+                for (uint32_t i = db.start[k]; i < db.start[k + 1]; ++i)
+                    occurrences[db.lits[i]] -= 1;
+            }
+            // Occurrences of assigned variables are not counted down; they
+            // are never looked at again.
+            for (uint32_t k : db.occurs[l ^ 1]) {
+                if (satisfied[k])
+                    continue;
+                open[k] -= 1;
+                if (open[k] == 0)
+                    conflict = true;
+                else if (open[k] == 1)
+                    assign_unit(k);
+            }
+        }
+    }
+};
+
+// Puts the fixed support variables back into the samples of the reduced
+// support.
+class SupportExpansion {
+    // The position in the full support of each reduced position; empty when
+    // nothing was fixed.
+    std::vector<int> positions;
+    // The full support with every free variable false.
+    Sample fixed;
+
+public:
+    void init(size_t full_size, const std::vector<int> & free_positions, const std::vector<signed char> & value, const std::vector<int> & full_ind) {
+        positions.clear();
+        if (free_positions.size() == full_size)
+            return;
+        positions = free_positions;
+        fixed = Sample(full_size);
+        for (size_t i = 0; i < full_size; ++i)
+            if (full_ind[i] > 0 && full_ind[i] < (int)value.size() && value[full_ind[i]] > 0)
+                fixed.set(i, true);
+    }
+
+    // Returns s itself when nothing was fixed, otherwise out.
+    const Sample & expand(const Sample & s, Sample & out) const {
+        if (positions.empty())
+            return s;
+        out = fixed;
+        const uint64_t * w = s.words();
+        for (size_t k = 0; k < s.nwords(); ++k)
+            for (uint64_t b = w[k]; b; b &= b - 1)
+                out.set(positions[64 * k + __builtin_ctzll(b)], true);
+        return out;
+    }
+};
+
+#endif
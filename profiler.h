@@ -0,0 +1,152 @@
+#ifndef QUICKSAMPLER_PROFILER_H
+#define QUICKSAMPLER_PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Cumulative time and a latency histogram for each phase of the sampler.
+// Times are counted in ticks of the TSC where there is one, otherwise in
+// nanoseconds, and converted to seconds with the rate measured over the run.
+// Recording is a few relaxed atomic adds, so the threads of one worker can
+// share a Profile. Phases nest: a flip includes the extraction of its model
+// and any local search, and a combination its dedup and output.
+class Profile {
+public:
+    enum Phase { PARSE, PREPROCESS, SOLVE, FLIP_SAT, FLIP_UNSAT, EXTRACT, SEARCH, COMBINE, DEDUP, OUTPUT, NUM_PHASES };
+
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return nanos();
+#endif
+    }
+
+    static uint64_t nanos() {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec * 1000000000ULL + t.tv_nsec;
+    }
+
+    Profile() {
+        for (Counter & c : counters) {
+            c.count = 0;
+            c.total = 0;
+            c.max = 0;
+            for (auto & b : c.buckets)
+                b = 0;
+        }
+    }
+
+    void record(Phase p, uint64_t t) {
+        Counter & c = counters[p];
+        c.count.fetch_add(1, std::memory_order_relaxed);
+        c.total.fetch_add(t, std::memory_order_relaxed);
+        c.buckets[bucket(t)].fetch_add(1, std::memory_order_relaxed);
+        uint64_t m = c.max.load(std::memory_order_relaxed);
+        while (t > m && !c.max.compare_exchange_weak(m, t, std::memory_order_relaxed))
+            ;
+    }
+
+    void add(const Profile & o) {
+        for (int p = 0; p < NUM_PHASES; ++p) {
+            const Counter & from = o.counters[p];
+            Counter & to = counters[p];
+            to.count += from.count.load(std::memory_order_relaxed);
+            to.total += from.total.load(std::memory_order_relaxed);
+            if (from.max > to.max)
+                to.max = from.max.load(std::memory_order_relaxed);
+            for (int b = 0; b < num_buckets; ++b)
+                to.buckets[b] += from.buckets[b].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Percentiles are upper bounds: the end of the histogram bucket.
+    void print(double ticks_per_second) const {
+        double us = 1.0e6 / ticks_per_second;
+        printf("%-12s %10s %10s %10s %10s %10s %10s %10s\n", "Phase", "count", "total s", "mean us", "p50 us", "p90 us", "p99 us", "max us");
+        for (int p = 0; p < NUM_PHASES; ++p) {
+            const Counter & c = counters[p];
+            uint64_t n = c.count;
+            if (n == 0)
+                continue;
+            printf("%-12s %10llu %10.3f %10.1f %10.1f %10.1f %10.1f %10.1f\n", name((Phase)p), (unsigned long long)n,
+                   c.total / ticks_per_second, us * c.total / n,
+                   us * percentile(c, 0.50), us * percentile(c, 0.90), us * percentile(c, 0.99), us * c.max);
+        }
+        fflush(stdout);
+    }
+
+    static const char * name(Phase p) {
+        static const char * names[NUM_PHASES] = {"parse", "preprocess", "solve", "flip sat", "flip unsat", "extract", "local search", "combine", "dedup", "output"};
+        return names[p];
+    }
+
+private:
+    enum { num_buckets = 64 };
+
+    // Bucket k holds times in [2^k, 2^(k+1)) ticks.
+    struct Counter {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> total;
+        std::atomic<uint64_t> max;
+        std::atomic<uint64_t> buckets[num_buckets];
+    };
+    Counter counters[NUM_PHASES];
+
+    static int bucket(uint64_t t) {
+        return 63 - __builtin_clzll(t | 1);
+    }
+
+    static double percentile(const Counter & c, double q) {
+        uint64_t n = c.count;
+        uint64_t seen = 0;
+        for (int b = 0; b < num_buckets; ++b) {
+            seen += c.buckets[b];
+            if (seen >= q * n)
+                return b == 63 ? (double)c.max : (double)std::min((uint64_t)2 << b, c.max.load());
+        }
+        return (double)c.max;
+    }
+};
+
+// Records the time from construction to destruction; does nothing without a
+// profile.
+class PhaseTimer {
+    Profile * profile;
+    Profile::Phase phase;
+    uint64_t start;
+
+public:
+    PhaseTimer(Profile * profile, Profile::Phase phase) : profile(profile), phase(phase), start(profile ? Profile::ticks() : 0) {}
+
+    ~PhaseTimer() {
+        if (profile)
+            profile->record(phase, Profile::ticks() - start);
+    }
+};
+
+// The rate of Profile::ticks(), measured from construction to now.
+class TickRate {
+    uint64_t ticks0;
+    uint64_t nanos0;
+
+public:
+    TickRate() : ticks0(Profile::ticks()), nanos0(Profile::nanos()) {}
+
+    double per_second() const {
+        uint64_t dn = Profile::nanos() - nanos0;
+        uint64_t dt = Profile::ticks() - ticks0;
+        if (dn == 0 || dt == 0)
+            return 1.0e9;
+        return dt * 1.0e9 / dn;
+    }
+};
+
+#endif
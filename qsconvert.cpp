@@ -0,0 +1,64 @@
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "writer.h"
+
+// Converts a binary .samples.bin file written by quicksampler -o binary to
+// the text format of .samples files.
+int main(int argc, char * argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: qsconvert input.samples.bin output.samples\n";
+        abort();
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in.is_open()) {
+        std::cout << "Error opening input file\n";
+        abort();
+    }
+    unsigned char head[16];
+    in.read((char *)head, sizeof(head));
+    if (!in || memcmp(head, sample_format::magic, 4) != 0) {
+        std::cout << "Not a binary samples file\n";
+        abort();
+    }
+    if (sample_format::get_u32(head + 4) != sample_format::version) {
+        std::cout << "Unsupported binary samples version\n";
+        abort();
+    }
+    uint32_t nvars = sample_format::get_u32(head + 8);
+    uint32_t record_size = sample_format::get_u32(head + 12);
+    if (record_size != sample_format::record_size(nvars)) {
+        std::cout << "Corrupt binary samples header\n";
+        abort();
+    }
+    in.ignore((std::streamsize)nvars * 4);
+
+    BufferedWriter out;
+    if (!out.open(argv[2])) {
+        std::cout << "Error opening output file\n";
+        abort();
+    }
+    const size_t batch = 4096;
+    std::vector<unsigned char> records(batch * record_size);
+    Sample s(nvars);
+    std::string text;
+    int nmut;
+    while (in) {
+        in.read((char *)records.data(), records.size());
+        size_t n = in.gcount() / record_size;
+        for (size_t r = 0; r < n; ++r) {
+            sample_format::read_binary(records.data() + r * record_size, s, nmut);
+            sample_format::append_text(text, s, nmut);
+        }
+        out.write(text);
+        text.clear();
+    }
+    out.close();
+    if (out.error()) {
+        std::cout << "Error writing output file: " << strerror(out.error()) << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -1,277 +1,1207 @@
+#include <signal.h>
 #include <string.h>
+#include <pthread.h>
 #include <z3++.h>
 #include <vector>
 #include <map>
 #include <unordered_set>
 #include <unordered_map>
-#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <thread>
 
+#include "backend.h"
+#include "budget.h"
+#include "cache.h"
+#include "clausedb.h"
+#include "decompose.h"
+#include "dedup.h"
+#include "dimacs.h"
+#include "epoch.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "preprocess.h"
+#include "profiler.h"
+#include "sample.h"
+#include "scheduler.h"
+#include "writer.h"
+
+class Worker;
+
+// Thrown out of Worker::solve() once a global limit is reached.
+struct Stop {};
+
+// State shared by all sampling threads: the parsed formula, the limits, the
+// counters and the output file.
 class QuickSampler {
+    friend class Worker;
+
     std::string input_file;
 
     struct timespec start_time;
     double solver_time = 0.0;
     int max_samples;
     double max_time;
+    int jobs;
+    int flip_threads;
+    // Each worker solves, combines and writes in three threads.
+    bool pipelined;
+    // Flips are ordered, and some skipped, by what they yielded before.
+    bool adaptive;
+    // Solver calls are limited to this multiple of the 90th percentile of
+    // earlier calls of their kind; 0 for no limit.
+    double budget_factor;
+    std::string backend;
+    // Steps of local search tried before each solver query; 0 for none.
+    size_t search_steps;
+    bool binary;
+    bool filter;
+    bool preprocess;
+    bool decompose;
+    // Formulas are loaded from and saved to an image next to the CNF.
+    bool use_cache;
+    std::string dedup;
+    size_t dedup_memory;
+    size_t epoch_budget;
+    size_t epoch_memory;
+    // Negative to seed from the clock.
+    long seed;
+    // Only the final statistics are printed.
+    bool quiet;
+    // Where to write metrics snapshots; empty for none.
+    std::string metrics_destination;
+    std::string metrics_format;
+    double metrics_interval;
+
+    // The phases outside the workers; each worker has its own profile.
+    Profile profile;
+    TickRate tick_rate;
 
-    z3::context c;
-    z3::optimize opt;
+    Formula formula;
+    // The independent support as written to the output; ind is the part of
+    // it left free by preprocessing, which the workers sample.
+    std::vector<int> support;
     std::vector<int> ind;
-    std::unordered_set<int> unsat_vars;
-    int epochs = 0;
-    int flips = 0;
-    int samples = 0;
-    int solver_calls = 0;
+    SupportExpansion expansion;
+    size_t fixed_units = 0;
+    size_t fixed_pure = 0;
+    size_t fixed_backbone = 0;
+    // The formula as one component, or its connected components with -D.
+    // Workers sample the components listed in sampled, and the composer
+    // joins samples of all components into samples of the whole support.
+    std::vector<Component> parts;
+    std::vector<size_t> sampled;
+    std::unique_ptr<Composer> composer;
+    // Shared by all workers with -a; null otherwise.
+    std::unique_ptr<FlipScheduler> scheduler;
+    // Null without -T.
+    std::unique_ptr<CallBudget> solve_budget;
+    std::unique_ptr<CallBudget> flip_budget;
+    std::vector<std::atomic<char>> unsat_vars;
+    std::atomic<int> num_unsat{0};
+    // Per variable: flips that ran out of time, and the first epoch in which
+    // it is flipped again.
+    std::vector<std::atomic<int>> flip_timeouts;
+    std::vector<std::atomic<int>> retry_epoch;
+    std::atomic<int> timeouts{0};
+    SearchStats search_stats;
+    std::atomic<int> epochs{0};
+    std::atomic<int> flips{0};
+    std::atomic<int> samples{0};
+    std::atomic<int> solver_calls{0};
+    std::atomic<int> filtered{0};
+    std::atomic<int> duplicates{0};
+    std::atomic<bool> stopped{false};
+
+    // Every sample written so far; null with -d none.
+    std::unique_ptr<SampleFilter> seen;
 
-    std::ofstream results_file;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex stats_mutex;
+    std::mutex output_mutex;
+    BufferedWriter results_file;
+
+    MetricsWriter metrics;
+    std::mutex metrics_mutex;
+    // Counters at the last snapshot, for the rates.
+    double last_elapsed = 0.0;
+    int last_samples = 0;
+    int last_flips = 0;
+    int last_calls = 0;
 
 public:
-    QuickSampler(std::string input, int max_samples, double max_time) : opt(c), input_file(input), max_samples(max_samples), max_time(max_time) {}
+    QuickSampler(std::string input, int max_samples, double max_time, int jobs, int flip_threads, bool pipelined, bool adaptive, double budget_factor, std::string backend, size_t search_steps, bool binary, bool filter, bool preprocess, bool decompose, bool use_cache, std::string dedup, size_t dedup_memory, size_t epoch_budget, size_t epoch_memory, long seed, bool quiet, std::string metrics_destination, std::string metrics_format, double metrics_interval) : input_file(input), max_samples(max_samples), max_time(max_time), jobs(jobs), flip_threads(flip_threads), pipelined(pipelined), adaptive(adaptive), budget_factor(budget_factor), backend(backend), search_steps(search_steps), binary(binary), filter(filter), preprocess(preprocess), decompose(decompose), use_cache(use_cache), dedup(dedup), dedup_memory(dedup_memory), epoch_budget(epoch_budget), epoch_memory(epoch_memory), seed(seed), quiet(quiet), metrics_destination(metrics_destination), metrics_format(metrics_format), metrics_interval(metrics_interval) {}
 
-    void run() {
-        clock_gettime(CLOCK_REALTIME, &start_time);
-        srand(start_time.tv_sec);
-        parse_cnf();
-        results_file.open(input_file + ".samples");
-        while (true) {
-            opt.push();
-            for (int v : ind) {
-                if (rand() % 2)
-                    opt.add(literal(v), 1);
-                else
-                    opt.add(!literal(v), 1);
-            }
-            if (!solve()) {
-                std::cout << "Could not find a solution!\n";
-		exit(0);
-	    }
-            z3::model m = opt.get_model();
-            opt.pop();
-
-            sample(m);
-            print_stats(false);
-        }
-    }
+    void run();
 
     void print_stats(bool simple) {
+        if (simple && quiet)
+            return;
         struct timespec end;
         clock_gettime(CLOCK_REALTIME, &end);
         double elapsed = duration(&start_time, &end);
+        std::lock_guard<std::mutex> lock(stats_mutex);
         std::cout << "Samples " << samples << '\n';
         std::cout << "Execution time " << elapsed << '\n';
         if (simple)
             return;
         std::cout << "Solver time: " << solver_time << '\n';
-        std::cout << "Epochs " << epochs << ", Flips " << flips << ", Unsat " << unsat_vars.size() << ", Calls " << solver_calls << '\n';
+        std::cout << "Epochs " << epochs << ", Flips " << flips << ", Unsat " << num_unsat << ", Calls " << solver_calls << '\n';
+        if (filter)
+            std::cout << "Filtered " << filtered << '\n';
+        if (search_steps > 0) {
+            std::cout.flush();
+            search_stats.print(tick_rate.per_second());
+        }
+        if (solve_budget || timeouts > 0) {
+            std::cout << "Timeouts " << timeouts;
+            if (solve_budget)
+                std::cout << ", solve limit " << solve_budget->limit() << " s, flip limit " << flip_budget->limit() << " s";
+            std::cout << '\n';
+        }
+        if (seen)
+            std::cout << "Duplicates " << duplicates << ", Dedup memory " << seen->memory() << '\n';
+        if (decompose)
+            std::cout << "Components " << parts.size() << ", enumerated " << parts.size() - sampled.size() << '\n';
+        if (preprocess)
+            std::cout << "Fixed " << support.size() - ind.size() << " of " << support.size() << " independent variables, " << fixed_backbone << " in the backbone; units " << fixed_units << " over all variables, pure " << fixed_pure << " outside the support\n";
+        if (scheduler) {
+            std::cout.flush();
+            scheduler->print(ind, tick_rate.per_second());
+        }
+    }
+
+    void print_epoch(int epoch_duplicates, int epoch_total) {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        std::cout << "Epoch duplicates " << epoch_duplicates << " / " << epoch_total;
+        if (epoch_total > 0)
+            std::cout << " (" << 100.0 * epoch_duplicates / epoch_total << "%)";
+        std::cout << '\n';
     }
 
     void parse_cnf() {
-        z3::expr_vector exp(c);
-        std::ifstream f(input_file);
-        if (!f.is_open()) {
-            std::cout << "Error opening input file\n";
+        std::unique_ptr<FormulaCache> cache;
+        Reduction reduction;
+        bool cached = false;
+        bool has_reduction = false;
+        {
+            PhaseTimer t(&profile, Profile::PARSE);
+            if (use_cache) {
+                cache.reset(new FormulaCache(input_file));
+                cached = cache->load(formula, preprocess ? &reduction : nullptr, has_reduction);
+            }
+            if (!cached && !DimacsLoader::load(input_file, formula)) {
+                std::cout << "Error opening input file\n";
+                abort();
+            }
+        }
+        support = formula.ind;
+        // Only a complete reduction is saved, so a run with a longer time
+        // limit can improve on it.
+        bool complete = false;
+        if (preprocess && !has_reduction)
+            complete = simplify(reduction);
+        if (cache && (complete || !cached))
+            cache->save(formula, complete ? &reduction : nullptr);
+        if (preprocess)
+            apply(reduction);
+        ind = formula.ind;
+        split();
+        if (adaptive)
+            scheduler.reset(new FlipScheduler(ind.size()));
+        seen.reset(SampleFilter::create(dedup, dedup_memory));
+        std::vector<std::atomic<char>>(ind.size()).swap(unsat_vars);
+        for (auto & u : unsat_vars)
+            u = 0;
+        std::vector<std::atomic<int>>(ind.size()).swap(flip_timeouts);
+        std::vector<std::atomic<int>>(ind.size()).swap(retry_epoch);
+        for (size_t i = 0; i < ind.size(); ++i) {
+            flip_timeouts[i] = 0;
+            retry_epoch[i] = 0;
+        }
+        if (budget_factor > 0) {
+            solve_budget.reset(new CallBudget(budget_factor));
+            flip_budget.reset(new CallBudget(budget_factor));
+        }
+    }
+
+    // Fixes the variables that take the same value in every model, within
+    // the time limit. Returns false if the backbone search gave up early.
+    bool simplify(Reduction & reduction) {
+        PhaseTimer t(&profile, Profile::PREPROCESS);
+        Preprocessor p(formula);
+        if (p.simplify()) {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            p.find_backbone(jobs * flip_threads, Preprocessor::now() + max_time - duration(&start_time, &now));
+        }
+        p.reduce(reduction);
+        return p.complete;
+    }
+
+    // Replaces the formula by the reduced one. The fixed variables of the
+    // support are put back into every sample written.
+    void apply(Reduction & reduction) {
+        expansion.init(support.size(), reduction.free_positions, reduction.value, support);
+        fixed_units = reduction.units;
+        fixed_pure = reduction.pure;
+        fixed_backbone = reduction.backbone;
+        std::swap(formula, reduction.formula);
+    }
+
+    void split() {
+        if (decompose) {
+            PhaseTimer t(&profile, Profile::PREPROCESS);
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            Decomposer::split(formula, parts, Preprocessor::now() + max_time - duration(&start_time, &now));
+        } else {
+            parts.resize(1);
+            for (size_t i = 0; i < ind.size(); ++i)
+                parts[0].positions.push_back(i);
+        }
+        if (parts.empty()) {
+            std::cout << "Error: empty independent support\n";
             abort();
         }
-        std::unordered_set<int> indset;
-        bool has_ind = false;
-        int max_var = 0;
-        std::string line;
-        while (getline(f, line)) {
-            std::istringstream iss(line);
-            if(line.find("c ind ") == 0) {
-                std::string s;
-                iss >> s;
-                iss >> s;
-                int v;
-                while (!iss.eof()) {
-                    iss >> v;
-                    if (v && indset.find(v) == indset.end()) {
-                        indset.insert(v);
-                        ind.push_back(v);
-                        has_ind = true;
-                    }
-                }
-            } else if (line[0] != 'c' && line[0] != 'p') {
-                z3::expr_vector clause(c);
-                int v;
-                while (!iss.eof()) {
-                    iss >> v;
-                    if (v > 0)
-                        clause.push_back(literal(v));
-                    else if (v < 0)
-                        clause.push_back(!literal(-v));
-                    v = abs(v);
-                    if (!has_ind && v != 0)
-                        indset.insert(v);
-                    if (v > max_var)
-                        max_var = v;
+        if (!decompose)
+            std::swap(parts[0].formula, formula);
+        formula = Formula();
+        for (size_t p = 0; p < parts.size(); ++p) {
+            if (parts[p].enumerated)
+                continue;
+            sampled.push_back(p);
+            if (filter)
+                parts[p].clauses.reset(new ClauseDB(parts[p].formula));
+        }
+        if (parts.size() > 1)
+            composer.reset(new Composer(parts, ind.size(), seed >= 0 ? seed : start_time.tv_sec));
+    }
+
+    // Returns false if the sample was already written, in any epoch.
+    bool accept(const Sample & sample) {
+        if (seen && !seen->insert(sample)) {
+            duplicates += 1;
+            return false;
+        }
+        samples += 1;
+        return true;
+    }
+
+    void write(std::string & buffer) {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        results_file.write(buffer);
+        buffer.clear();
+    }
+
+    // Checks the global limits before a solver call.
+    void check_limits() {
+        if (stopped)
+            throw Stop();
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        double elapsed = duration(&start_time, &now);
+        if (elapsed > max_time)
+            stop("Stopping: timeout\n");
+        if (samples >= max_samples)
+            stop("Stopping: samples\n");
+    }
+
+    // The first worker to stop interrupts all others.
+    void stop(const char * reason);
+
+    // Stops the run from outside the workers. Returns false if it was
+    // stopped already.
+    bool request_stop(const char * reason);
+
+    void print_profile();
+
+    // SIGINT and SIGTERM stop the run, which still writes its samples and
+    // prints its statistics; SIGUSR1 prints the profile so far. Signals are
+    // taken by one thread with sigwait, so workers never run a handler.
+    void handle_signals();
+
+    // Writes a snapshot of the counters every metrics_interval seconds from
+    // a thread of its own. Without a destination no thread is started, and
+    // the workers only keep two relaxed atomics up to date.
+    void export_metrics();
+
+    // Stops the run at the time limit from a thread of its own, which
+    // interrupts the solver calls running then; the workers only check the
+    // limit between calls.
+    void watch_deadline();
+
+    void write_metrics();
+
+    void finish() {
+        print_stats(false);
+        print_profile();
+        if (!metrics_destination.empty())
+            write_metrics();
+        results_file.close();
+        if (results_file.error()) {
+            std::cout << "Error writing samples: " << strerror(results_file.error()) << '\n';
+            exit(1);
+        }
+        exit(0);
+    }
+
+    void add_solver_time(double t) {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        solver_time += t;
+        solver_calls += 1;
+    }
+
+    void mark_unsat(int i) {
+        if (!unsat_vars[i].exchange(1))
+            num_unsat += 1;
+    }
+
+    // A flip that ran out of time is not an unsat answer: the variable is
+    // left out of the next 2, 4, 8, ... epochs, up to 1024, and tried again.
+    void mark_timeout(int i) {
+        timeouts += 1;
+        int k = std::min(flip_timeouts[i].fetch_add(1), 9);
+        retry_epoch[i] = epochs + (2 << k);
+    }
+
+    bool can_flip(int i) const {
+        return !unsat_vars[i] && epochs >= retry_epoch[i];
+    }
+
+    static double duration(struct timespec * a, struct timespec * b) {
+        return (b->tv_sec - a->tv_sec) + 1.0e-9 * (b->tv_nsec - a->tv_nsec);
+    }
+};
+
+// One sampling thread. Workers run independent epochs from their own random
+// seeds. With flip_threads > 1, the flips of an epoch are spread over that
+// many backends and merged back in variable order.
+//
+// In pipelined mode the worker runs three threads joined by SPSC queues: the
+// solver thread sends the base and the flips of each epoch, in order, to a
+// combination thread, which builds the mutations and dedups them, and passes
+// the samples to keep to a writer thread. The combination thread sees the
+// same sequence of flips as the solver would, so the samples of an epoch are
+// the same, but the solver goes on with the next flips meanwhile.
+class Worker {
+    // The solvers of one component.
+    struct Solvers {
+        std::unique_ptr<Backend> main;
+        std::vector<std::unique_ptr<Backend>> helpers;
+        std::unique_ptr<Propagator> propagator;
+    };
+
+    QuickSampler & qs;
+    // Indexed like qs.parts; only sampled components have solvers.
+    std::vector<Solvers> solvers;
+    std::mt19937 rng;
+    std::string buffer;
+    int epoch_duplicates = 0;
+    int epoch_total = 0;
+
+    // Outcome of one flip query when flips run in parallel.
+    struct Flip {
+        enum { NONE, SAT, UNSAT, TIMEOUT } status = NONE;
+        Sample sample;
+    };
+
+    // From the solver thread to the combination thread.
+    struct Event {
+        enum Kind { START, FLIP, END } kind = START;
+        // The component of the epoch, for START.
+        size_t part = 0;
+        // The flipped position in the support, for FLIP.
+        size_t var = 0;
+        Sample sample;
+    };
+
+    // From the combination thread to the writer thread; a negative nmut
+    // closes the writer.
+    struct Record {
+        Sample sample;
+        int nmut = 0;
+    };
+
+    enum { queue_size = 4096 };
+
+    // The epoch being combined.
+    std::unique_ptr<Epoch> epoch;
+    // Pipelined mode only, with the values last pushed, whose buffers are
+    // reused.
+    std::unique_ptr<SpscQueue<Event>> events;
+    std::unique_ptr<SpscQueue<Record>> records;
+    Event event;
+    Record record;
+    // The last sample written, with the fixed variables put back.
+    Sample expanded;
+    // The samples of the whole support last built by the composer.
+    Composer::Batch batch;
+
+public:
+    // Shared by the worker's flip threads.
+    Profile profile;
+    // The mutations of the current epoch, for the metrics.
+    std::atomic<size_t> mutation_count{0};
+    std::atomic<size_t> mutation_memory{0};
+
+    Worker(QuickSampler & qs, unsigned seed, int flip_threads) : qs(qs), solvers(qs.parts.size()), rng(seed) {
+        for (size_t p : qs.sampled) {
+            Solvers & s = solvers[p];
+            s.main.reset(create_backend(seed));
+            for (int k = 1; k < flip_threads; ++k)
+                s.helpers.emplace_back(create_backend(seed + 7919 * k));
+        }
+    }
+
+    // The backend chosen with -b, behind local search with -l.
+    Backend * create_backend(unsigned seed) {
+        Backend * b = Backend::create(qs.backend, seed);
+        b->set_profile(&profile);
+        if (qs.search_steps > 0) {
+            b = new LocalSearchBackend(b, seed, qs.search_steps, &qs.search_stats);
+            b->set_profile(&profile);
+        }
+        return b;
+    }
+
+    void run() {
+        std::thread combiner;
+        std::thread writer;
+        try {
+            for (size_t p : qs.sampled) {
+                const Component & c = qs.parts[p];
+                solvers[p].main->load(c.formula);
+                for (auto & h : solvers[p].helpers)
+                    h->load(c.formula);
+                if (c.clauses)
+                    solvers[p].propagator.reset(new Propagator(*c.clauses));
+            }
+            if (qs.pipelined) {
+                events.reset(new SpscQueue<Event>(queue_size));
+                records.reset(new SpscQueue<Record>(queue_size));
+                writer = std::thread(&Worker::write_records, this);
+                combiner = std::thread(&Worker::combine_events, this);
+            }
+            // Epochs take the sampled components in turn.
+            Sample base;
+            for (size_t turn = 0; ; ++turn) {
+                size_t p = qs.sampled[turn % qs.sampled.size()];
+                Sample target(qs.parts[p].formula.ind.size());
+                for (size_t i = 0; i < target.size(); ++i)
+                    target.set(i, rng() & 1);
+                Backend & main = *solvers[p].main;
+                Backend::Result result = solve(main, qs.solve_budget.get(), [&] { return main.solve(target, base); }, Profile::SOLVE, Profile::SOLVE);
+                // The next epoch starts from another target.
+                if (result == Backend::UNKNOWN) {
+                    qs.timeouts += 1;
+                    continue;
                 }
-                if (clause.size() > 0)
-		    exp.push_back(mk_or(clause));
+                if (result != Backend::SAT)
+                    qs.stop("Could not find a solution!\n");
+
+                sample(p, base);
+                if (!qs.quiet)
+                    qs.print_stats(false);
             }
+        } catch (Stop &) {
+        } catch (z3::exception &) {
+            if (!qs.stopped)
+                throw;
         }
-        f.close();
-        if (!has_ind) {
-            for (int lit = 0; lit <= max_var; ++lit) {
-                if (indset.find(lit) != indset.end()) {
-                    ind.push_back(lit);
+        if (combiner.joinable()) {
+            combiner.join();
+            writer.join();
+        } else {
+            flush();
+        }
+    }
+
+    void interrupt() {
+        for (size_t p : qs.sampled) {
+            solvers[p].main->interrupt();
+            for (auto & h : solvers[p].helpers)
+                h->interrupt();
+        }
+    }
+
+    void sample(size_t part, const Sample & base) {
+        if (!qs.quiet)
+            std:: cout << base.to_string() << " STARTING\n";
+        if (events)
+            send(Event::START, base, part);
+        else
+            begin_epoch(part, base);
+        if (solvers[part].helpers.empty())
+            flip_sequential(part, base);
+        else
+            flip_parallel(part, base);
+        if (events)
+            send(Event::END, base);
+        else
+            end_epoch();
+    }
+
+    void begin_epoch(size_t part, const Sample & base) {
+        epoch.reset(new Epoch(part, base, qs.epoch_budget, qs.epoch_memory, &profile));
+        epoch_duplicates = 0;
+        epoch_total = 0;
+        output(base, 0);
+    }
+
+    void end_epoch() {
+        combine(*epoch, (size_t)-1);
+        epoch.reset();
+        qs.epochs += 1;
+        mutation_count.store(0, std::memory_order_relaxed);
+        mutation_memory.store(0, std::memory_order_relaxed);
+        if (qs.seen && !qs.quiet)
+            qs.print_epoch(epoch_duplicates, epoch_total);
+        if (!records)
+            flush();
+    }
+
+    // A flip of the current epoch, handed to the combination thread in
+    // pipelined mode.
+    void found(const Sample & new_sample, size_t var) {
+        if (events)
+            send(Event::FLIP, new_sample, 0, var);
+        else
+            combine_flip(new_sample, var);
+    }
+
+    // Waits only when the combination thread is a whole queue behind.
+    void send(Event::Kind kind, const Sample & sample, size_t part = 0, size_t var = 0) {
+        event.kind = kind;
+        event.part = part;
+        event.var = var;
+        event.sample = sample;
+        Backoff backoff;
+        while (!events->try_push(event)) {
+            if (qs.stopped)
+                throw Stop();
+            backoff.pause();
+        }
+    }
+
+    // The combination thread: runs the epochs sent by the solver thread
+    // until the run stops, then closes the writer.
+    void combine_events() {
+        try {
+            Event e;
+            Backoff backoff;
+            while (!qs.stopped) {
+                if (!events->try_pop(e)) {
+                    backoff.pause();
+                    continue;
                 }
+                backoff.reset();
+                if (e.kind == Event::START)
+                    begin_epoch(e.part, e.sample);
+                else if (e.kind == Event::FLIP)
+                    combine_flip(e.sample, e.var);
+                else
+                    end_epoch();
             }
+        } catch (Stop &) {
         }
-        z3::expr formula = mk_and(exp);
-        opt.add(formula);
-    }
-
-    void sample(z3::model m) {
-        std::unordered_set<std::string> initial_mutations;
-        std::string m_string = model_string(m);
-        std:: cout << m_string << " STARTING\n";
-        output(m_string, 0);
-        opt.push();
-        for (int i = 0; i < ind.size(); ++i) {
-            int v = ind[i];
-            if (m_string[i] == '1')
-                opt.add(literal(v), 1);
-            else
-                opt.add(!literal(v), 1);
+        record.nmut = -1;
+        push(record);
+    }
+
+    void combine_flip(const Sample & new_sample, size_t var) {
+        flipped(*epoch, new_sample, var);
+        combine(*epoch, epoch->slice);
+    }
+
+    // The writer thread: formats every sample kept until closed.
+    void write_records() {
+        Record r;
+        Backoff backoff;
+        while (true) {
+            if (!records->try_pop(r)) {
+                backoff.pause();
+                continue;
+            }
+            backoff.reset();
+            if (r.nmut < 0)
+                break;
+            append(r.sample, r.nmut);
         }
+        flush();
+    }
 
-        std::unordered_map<std::string, int> mutations;
-        for (int i = 0; i < ind.size(); ++i) {
-            if (unsat_vars.find(i) != unsat_vars.end())
+    // The writer drains the queue until it is closed, so this never waits
+    // for long.
+    void push(const Record & r) {
+        Backoff backoff;
+        while (!records->try_push(r))
+            backoff.pause();
+    }
+
+    void flip_sequential(size_t part, const Sample & base) {
+        Backend & main = *solvers[part].main;
+        const std::vector<size_t> & positions = qs.parts[part].positions;
+        main.set_base(base);
+        Sample new_sample;
+        std::vector<size_t> order;
+        plan(positions, order);
+        for (size_t i : order) {
+            if (!qs.can_flip(positions[i]))
                 continue;
-            opt.push();
-            int v = ind[i];
-            if (m_string[i] == '1')
-                opt.add(!literal(v));
-            else
-                opt.add(literal(v));
-            if (solve()) {
-                z3::model new_model = opt.get_model();
-                std::string new_string = model_string(new_model);
-                if (initial_mutations.find(new_string) == initial_mutations.end()) {
-                    initial_mutations.insert(new_string);
-                    //std::cout << new_string << '\n';
-                    std::unordered_map<std::string, int> new_mutations;
-                    new_mutations[new_string] = 1;
-                    output(new_string, 1);
-                    flips += 1;
-                    for (auto it : mutations) {
-                        if (it.second >= 6)
-                            continue;
-                        std::string candidate;
-                        for (int j = 0; j < ind.size(); ++j) {
-                            bool a = m_string[j] == '1';
-                            bool b = it.first[j] == '1';
-                            bool c = new_string[j] == '1';
-                            if (a ^ ((a^b) | (a^c)))
-                                candidate += '1';
-                            else
-                                candidate += '0';
-                        }
-                        if (mutations.find(candidate) == mutations.end() && new_mutations.find(candidate) == new_mutations.end()) {
-                            new_mutations[candidate] = it.second + 1;
-                            output(candidate, it.second + 1);
-                        }
-                    }
-                    for (auto it : new_mutations) {
-                        mutations[it.first] = it.second;
-                    }
-                } else {
-                    //std::cout << new_string << " repeated\n";
-                }
+            Backend::Result result = try_flip(main, i, positions[i], new_sample);
+            if (result == Backend::SAT) {
+                found(new_sample, positions[i]);
+            } else if (result == Backend::UNKNOWN) {
+                qs.mark_timeout(positions[i]);
             } else {
-                std::cout << "unsat\n";
-                unsat_vars.insert(i);
+                if (!qs.quiet)
+                    std::cout << "unsat\n";
+                qs.mark_unsat(positions[i]);
             }
-            opt.pop();
-            print_stats(true);
+            qs.print_stats(true);
         }
-        epochs += 1;
-        opt.pop();
+        main.clear_base();
     }
 
-    void output(std::string sample, int nmut) {
-        samples += 1;
-        results_file << nmut << ": " << sample << '\n';
+    // Of n solvers, solver t makes the flips t, t + n, t + 2n, ... of the
+    // plan, so the model of each flip does not depend on which solver was
+    // free first. The results are merged afterwards in the planned order, so
+    // the mutations built do not depend on which solver finished first.
+    void flip_parallel(size_t part, const Sample & base) {
+        const std::vector<size_t> & positions = qs.parts[part].positions;
+        size_t n = base.size();
+        std::vector<Flip> results(n);
+        std::vector<size_t> order;
+        plan(positions, order);
+        size_t nsolvers = solvers[part].helpers.size() + 1;
+        std::atomic<bool> stopped{false};
+        auto work = [&](Backend & b, size_t t) {
+            try {
+                b.set_base(base);
+                for (size_t k = t; k < order.size(); k += nsolvers) {
+                    size_t i = order[k];
+                    if (!qs.can_flip(positions[i]))
+                        continue;
+                    Backend::Result result = try_flip(b, i, positions[i], results[i].sample);
+                    if (result == Backend::SAT)
+                        results[i].status = Flip::SAT;
+                    else if (result == Backend::UNKNOWN)
+                        results[i].status = Flip::TIMEOUT;
+                    else
+                        results[i].status = Flip::UNSAT;
+                }
+                b.clear_base();
+            } catch (Stop &) {
+                stopped = true;
+            } catch (z3::exception &) {
+                // Interrupted contexts refuse further work once stopped.
+                if (!qs.stopped)
+                    throw;
+                stopped = true;
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < nsolvers; ++t)
+            threads.emplace_back(work, std::ref(*solvers[part].helpers[t - 1]), t);
+        work(*solvers[part].main, 0);
+        for (auto & t : threads)
+            t.join();
+
+        for (size_t i : order) {
+            if (results[i].status == Flip::SAT) {
+                found(results[i].sample, positions[i]);
+            } else if (results[i].status == Flip::TIMEOUT) {
+                qs.mark_timeout(positions[i]);
+            } else if (results[i].status == Flip::UNSAT) {
+                if (!qs.quiet)
+                    std::cout << "unsat\n";
+                qs.mark_unsat(positions[i]);
+            }
+        }
+        if (stopped)
+            throw Stop();
     }
 
-    void finish() {
-        print_stats(false);
-        results_file.close();
-        exit(0);
+    // The indices of the flips to make this epoch, in order: all of them, or
+    // those the scheduler picks with -a.
+    void plan(const std::vector<size_t> & positions, std::vector<size_t> & order) {
+        if (qs.scheduler) {
+            qs.scheduler->plan(positions, [&](size_t var) { return !qs.can_flip(var); }, rng, order);
+            return;
+        }
+        order.resize(positions.size());
+        std::iota(order.begin(), order.end(), 0);
     }
 
-    bool solve() {
-        struct timespec start;
-        clock_gettime(CLOCK_REALTIME, &start);
-        double elapsed = duration(&start_time, &start);
-        if (elapsed > max_time) {
-            std::cout << "Stopping: timeout\n";
-            finish();
+    // One flip query, timed for the scheduler with -a.
+    Backend::Result try_flip(Backend & b, size_t i, size_t var, Sample & out) {
+        uint64_t start = Profile::ticks();
+        Backend::Result result = solve(b, qs.flip_budget.get(), [&] { return b.flip(i, out); }, Profile::FLIP_SAT, Profile::FLIP_UNSAT);
+        if (qs.scheduler)
+            qs.scheduler->record(var, result == Backend::SAT, Profile::ticks() - start);
+        return result;
+    }
+
+    // Records the model of a successful flip of the support position var.
+    // Its combinations with the mutations found so far are made by
+    // combine(), and every new sample is credited to the newest flip in it.
+    void flipped(Epoch & e, const Sample & new_sample, size_t var) {
+        if (!e.add_flip(new_sample, var))
+            return;
+        publish(e);
+        if (output(new_sample, 1) && qs.scheduler)
+            qs.scheduler->credit(var);
+        qs.flips += 1;
+    }
+
+    // Makes up to limit candidates of the epoch and outputs the new ones.
+    // The limits are checked every few candidates, so -n and -t stop a long
+    // epoch promptly.
+    void combine(Epoch & e, size_t limit) {
+        // Rejected candidates stay in the mutation set, so the combinations
+        // explored are the same with or without -f.
+        Propagator * propagator = solvers[e.part].propagator.get();
+        e.combine(limit, [&](bool fresh, int depth, size_t f) {
+            if (e.generated % 64 == 0) {
+                publish(e);
+                qs.check_limits();
+            }
+            if (!fresh)
+                return;
+            if (propagator && !propagator->check(e.candidate))
+                qs.filtered += 1;
+            else if (output(e.candidate, depth) && qs.scheduler)
+                qs.scheduler->credit(e.flip_vars[f]);
+        });
+        publish(e);
+    }
+
+    // Updates the mutation counts for the metrics.
+    void publish(const Epoch & e) {
+        mutation_count.store(e.mutations.size(), std::memory_order_relaxed);
+        mutation_memory.store(e.memory, std::memory_order_relaxed);
+    }
+
+    // Outputs a sample of the epoch's component: itself if it is the whole
+    // formula, otherwise the samples the composer makes from it. Returns
+    // false if it was a duplicate.
+    bool output(const Sample & sample, int nmut) {
+        epoch_total += 1;
+        if (!qs.composer) {
+            if (keep(sample, nmut))
+                return true;
+            epoch_duplicates += 1;
+            return false;
         }
-        if (samples >= max_samples) {
-            std::cout << "Stopping: samples\n";
-            finish();
+        size_t made = 0;
+        auto emit = [&](const Sample & full, int depth) {
+            keep(full, depth);
+            if (++made % 64 == 0)
+                qs.check_limits();
+        };
+        if (qs.composer->add(epoch->part, sample, nmut, batch, emit))
+            return true;
+        epoch_duplicates += 1;
+        return false;
+    }
+
+    // Writes a sample of the whole support unless it was written before.
+    bool keep(const Sample & sample, int nmut) {
+        uint64_t start = Profile::ticks();
+        bool accepted = qs.accept(sample);
+        uint64_t end = Profile::ticks();
+        profile.record(Profile::DEDUP, end - start);
+        if (!accepted)
+            return false;
+        if (records) {
+            record.sample = sample;
+            record.nmut = nmut;
+            push(record);
+        } else {
+            append(sample, nmut);
         }
+        return true;
+    }
+
+    void append(const Sample & sample, int nmut) {
+        PhaseTimer t(&profile, Profile::OUTPUT);
+        const Sample & full = qs.expansion.expand(sample, expanded);
+        if (qs.binary)
+            sample_format::append_binary(buffer, full, nmut);
+        else
+            sample_format::append_text(buffer, full, nmut);
+        if (buffer.size() >= (1 << 16))
+            flush();
+    }
 
-        z3::check_result result = opt.check();
+    void flush() {
+        if (!buffer.empty())
+            qs.write(buffer);
+    }
+
+    // Times the query as sat_phase if it is satisfiable, other_phase if not.
+    // With a budget, the query on b is limited to the budget's time, and
+    // its latency goes into the budget.
+    template <typename Query>
+    Backend::Result solve(Backend & b, CallBudget * budget, Query query, Profile::Phase sat_phase, Profile::Phase other_phase) {
+        double limit = 0;
+        if (budget) {
+            limit = budget->limit();
+            b.set_time_limit(limit);
+        }
+        // Checked last, right before the call, to leave the least room for
+        // a stop that comes before the call can be interrupted.
+        qs.check_limits();
+
+        struct timespec start;
+        clock_gettime(CLOCK_REALTIME, &start);
+        uint64_t start_ticks = Profile::ticks();
+        Backend::Result result;
+        try {
+            result = query();
+        } catch (z3::exception &) {
+            if (qs.stopped)
+                throw Stop();
+            throw;
+        }
         struct timespec end;
         clock_gettime(CLOCK_REALTIME, &end);
-        solver_time += duration(&start, &end);
-        solver_calls += 1;
+        profile.record(result == Backend::SAT ? sat_phase : other_phase, Profile::ticks() - start_ticks);
+        double seconds = QuickSampler::duration(&start, &end);
+        // Answers found by local search are not solver calls, and say nothing
+        // of the solver's times.
+        if (!b.answered_locally()) {
+            qs.add_solver_time(seconds);
+            if (budget)
+                budget->record(result == Backend::UNKNOWN && limit > 0 ? limit : seconds);
+        }
 
-        return result == z3::sat;
+        // An interrupted call is not an unsat answer.
+        if (qs.stopped)
+            throw Stop();
+        return result;
     }
+};
+
+void QuickSampler::stop(const char * reason) {
+    request_stop(reason);
+    throw Stop();
+}
+
+bool QuickSampler::request_stop(const char * reason) {
+    if (stopped.exchange(true))
+        return false;
+    std::cout << reason;
+    for (auto & w : workers)
+        w->interrupt();
+    return true;
+}
 
-    std::string model_string(z3::model model) {
-        std::string s;
+void QuickSampler::print_profile() {
+    Profile total;
+    total.add(profile);
+    for (auto & w : workers)
+        total.add(w->profile);
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    std::cout.flush();
+    total.print(tick_rate.per_second());
+}
 
-        for (int v : ind) {
-            z3::func_decl decl(literal(v).decl());
-            z3::expr b = model.get_const_interp(decl);
-            if (b.bool_value() == Z3_L_TRUE) {
-                s += "1";
+void QuickSampler::handle_signals() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    std::thread([this, set] {
+        int sig;
+        while (sigwait(&set, &sig) == 0) {
+            if (sig == SIGUSR1) {
+                print_profile();
             } else {
-                s += "0";
+                request_stop("Stopping: signal\n");
+                return;
             }
         }
-        return s;
-    }
+    }).detach();
+}
 
+void QuickSampler::watch_deadline() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    double left = max_time - duration(&start_time, &now);
+    std::thread([this, left] {
+        if (left > 0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(left));
+        request_stop("Stopping: timeout\n");
+    }).detach();
+}
 
-    double duration(struct timespec * a, struct timespec * b) {
-        return (b->tv_sec - a->tv_sec) + 1.0e-9 * (b->tv_nsec - a->tv_nsec);
+void QuickSampler::export_metrics() {
+    if (!metrics.open(metrics_destination, metrics_format)) {
+        std::cout << "Error opening metrics destination\n";
+        abort();
     }
+    std::thread([this] {
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(metrics_interval));
+            write_metrics();
+        }
+    }).detach();
+}
 
-    z3::expr literal(int v) {
-        return c.constant(c.str_symbol(std::to_string(v).c_str()), c.bool_sort());
+void QuickSampler::write_metrics() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    double elapsed = duration(&start_time, &now);
+    double time_in_solver;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        time_in_solver = solver_time;
     }
-};
+    size_t mutation_count = 0;
+    size_t mutation_memory = 0;
+    for (auto & w : workers) {
+        mutation_count += w->mutation_count.load(std::memory_order_relaxed);
+        mutation_memory += w->mutation_memory.load(std::memory_order_relaxed);
+    }
+    int n_samples = samples;
+    int n_flips = flips;
+    int n_calls = solver_calls;
+
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    double interval = elapsed - last_elapsed;
+    if (interval <= 0.0)
+        interval = 1.0;
+    std::vector<Metric> snapshot = {
+        {"elapsed_seconds", "gauge", "Time since the start of the run.", elapsed},
+        {"samples", "counter", "Samples written.", (double)n_samples},
+        {"epochs", "counter", "Epochs completed.", (double)epochs},
+        {"flips", "counter", "Distinct flips found.", (double)n_flips},
+        {"solver_calls", "counter", "Calls to the solver.", (double)n_calls},
+        {"solver_time_seconds", "counter", "Time spent in the solver, summed over threads.", time_in_solver},
+        {"unsat_vars", "gauge", "Independent variables that cannot be flipped.", (double)num_unsat},
+        {"timeouts", "counter", "Solver calls that ran out of time.", (double)timeouts},
+        {"duplicates", "counter", "Samples dropped as already written.", (double)duplicates},
+        {"filtered", "counter", "Candidates rejected by unit propagation.", (double)filtered},
+        {"samples_per_second", "gauge", "Samples written per second since the last snapshot.", (n_samples - last_samples) / interval},
+        {"flips_per_second", "gauge", "Flips found per second since the last snapshot.", (n_flips - last_flips) / interval},
+        {"solver_calls_per_second", "gauge", "Solver calls per second since the last snapshot.", (n_calls - last_calls) / interval},
+        {"mutations", "gauge", "Mutations kept by the current epochs.", (double)mutation_count},
+        {"mutations_memory_bytes", "gauge", "Estimated memory of the current epochs' mutations.", (double)mutation_memory},
+        {"dedup_memory_bytes", "gauge", "Memory of the set of samples written.", seen ? (double)seen->memory() : 0.0},
+    };
+    last_elapsed = elapsed;
+    last_samples = n_samples;
+    last_flips = n_flips;
+    last_calls = n_calls;
+    metrics.write(snapshot, now.tv_sec + 1.0e-9 * now.tv_nsec);
+}
+
+void QuickSampler::run() {
+    clock_gettime(CLOCK_REALTIME, &start_time);
+    parse_cnf();
+    if (binary) {
+        results_file.open(input_file + ".samples.bin");
+        results_file.write(sample_format::header(support));
+    } else {
+        results_file.open(input_file + ".samples");
+    }
+    if (!results_file.is_open()) {
+        std::cout << "Error opening output file\n";
+        abort();
+    }
+    unsigned first_seed = seed >= 0 ? seed : start_time.tv_sec;
+    for (int j = 0; j < jobs; ++j)
+        workers.emplace_back(new Worker(*this, first_seed + j, flip_threads));
+    // Blocks the signals in every thread started from here on.
+    handle_signals();
+    watch_deadline();
+    if (!metrics_destination.empty())
+        export_metrics();
+    std::vector<std::thread> threads;
+    for (auto & w : workers)
+        threads.emplace_back(&Worker::run, w.get());
+    for (auto & t : threads)
+        t.join();
+    finish();
+}
 
 int main(int argc, char * argv[]) {
     int max_samples = 10000000;
     double max_time = 7200.0;
+    int jobs = 1;
+    int flip_threads = 1;
+    bool pipelined = false;
+    bool adaptive = false;
+    double budget_factor = 0.0;
+    std::string backend = "optimize";
+    size_t search_steps = 0;
+    bool binary = false;
+    bool filter = false;
+    bool preprocess = false;
+    bool decompose = false;
+    bool use_cache = false;
+    std::string dedup = "exact";
+    size_t dedup_memory = (size_t)256 << 20;
+    size_t epoch_budget = 1000000;
+    size_t epoch_memory = (size_t)512 << 20;
+    long seed = -1;
+    bool quiet = false;
+    std::string metrics_destination;
+    std::string metrics_format = "json";
+    double metrics_interval = 10.0;
     if (argc < 2) {
         std::cout << "Argument required: input file\n";
         abort();
     }
     bool arg_samples = false;
     bool arg_time = false;
+    bool arg_jobs = false;
+    bool arg_flip_threads = false;
+    bool arg_budget = false;
+    bool arg_search = false;
+    bool arg_backend = false;
+    bool arg_format = false;
+    bool arg_dedup = false;
+    bool arg_dedup_memory = false;
+    bool arg_epoch_budget = false;
+    bool arg_epoch_memory = false;
+    bool arg_seed = false;
+    bool arg_metrics = false;
+    bool arg_metrics_format = false;
+    bool arg_metrics_interval = false;
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "-n") == 0)
             arg_samples = true;
         else if (strcmp(argv[i], "-t") == 0)
             arg_time = true;
+        else if (strcmp(argv[i], "-j") == 0)
+            arg_jobs = true;
+        else if (strcmp(argv[i], "-p") == 0)
+            arg_flip_threads = true;
+        else if (strcmp(argv[i], "-T") == 0)
+            arg_budget = true;
+        else if (strcmp(argv[i], "-l") == 0)
+            arg_search = true;
+        else if (strcmp(argv[i], "-b") == 0)
+            arg_backend = true;
+        else if (strcmp(argv[i], "-o") == 0)
+            arg_format = true;
+        else if (strcmp(argv[i], "-f") == 0)
+            filter = true;
+        else if (strcmp(argv[i], "-P") == 0)
+            pipelined = true;
+        else if (strcmp(argv[i], "-a") == 0)
+            adaptive = true;
+        else if (strcmp(argv[i], "-B") == 0)
+            preprocess = true;
+        else if (strcmp(argv[i], "-D") == 0)
+            decompose = true;
+        else if (strcmp(argv[i], "-c") == 0)
+            use_cache = true;
+        else if (strcmp(argv[i], "-q") == 0)
+            quiet = true;
+        else if (strcmp(argv[i], "-d") == 0)
+            arg_dedup = true;
+        else if (strcmp(argv[i], "-m") == 0)
+            arg_dedup_memory = true;
+        else if (strcmp(argv[i], "-e") == 0)
+            arg_epoch_budget = true;
+        else if (strcmp(argv[i], "-M") == 0)
+            arg_epoch_memory = true;
+        else if (strcmp(argv[i], "-s") == 0)
+            arg_seed = true;
+        else if (strcmp(argv[i], "-x") == 0)
+            arg_metrics = true;
+        else if (strcmp(argv[i], "-X") == 0)
+            arg_metrics_format = true;
+        else if (strcmp(argv[i], "-i") == 0)
+            arg_metrics_interval = true;
         else if (arg_samples) {
             arg_samples = false;
             max_samples = atoi(argv[i]);
         } else if (arg_time) {
             arg_time = false;
             max_time = atof(argv[i]);
+        } else if (arg_jobs) {
+            arg_jobs = false;
+            jobs = atoi(argv[i]);
+            if (jobs < 1)
+                jobs = 1;
+        } else if (arg_flip_threads) {
+            arg_flip_threads = false;
+            flip_threads = atoi(argv[i]);
+            if (flip_threads < 1)
+                flip_threads = 1;
+        } else if (arg_budget) {
+            arg_budget = false;
+            budget_factor = atof(argv[i]);
+            if (budget_factor < 0)
+                budget_factor = 0;
+        } else if (arg_search) {
+            arg_search = false;
+            int steps = atoi(argv[i]);
+            search_steps = steps > 0 ? steps : 0;
+        } else if (arg_backend) {
+            arg_backend = false;
+            backend = argv[i];
+            if (!Backend::exists(backend)) {
+                std::cout << "Unknown backend " << backend << '\n';
+                abort();
+            }
+        } else if (arg_format) {
+            arg_format = false;
+            if (strcmp(argv[i], "binary") == 0) {
+                binary = true;
+            } else if (strcmp(argv[i], "text") != 0) {
+                std::cout << "Unknown output format " << argv[i] << '\n';
+                abort();
+            }
+        } else if (arg_dedup) {
+            arg_dedup = false;
+            dedup = argv[i];
+            if (!SampleFilter::exists(dedup)) {
+                std::cout << "Unknown dedup mode " << dedup << '\n';
+                abort();
+            }
+        } else if (arg_dedup_memory) {
+            arg_dedup_memory = false;
+            dedup_memory = (size_t)(atof(argv[i]) * (1 << 20));
+        } else if (arg_epoch_budget) {
+            arg_epoch_budget = false;
+            epoch_budget = atol(argv[i]);
+        } else if (arg_epoch_memory) {
+            arg_epoch_memory = false;
+            epoch_memory = (size_t)(atof(argv[i]) * (1 << 20));
+        } else if (arg_seed) {
+            arg_seed = false;
+            seed = atol(argv[i]);
+        } else if (arg_metrics) {
+            arg_metrics = false;
+            metrics_destination = argv[i];
+        } else if (arg_metrics_format) {
+            arg_metrics_format = false;
+            metrics_format = argv[i];
+            if (!MetricsWriter::format_exists(metrics_format)) {
+                std::cout << "Unknown metrics format " << metrics_format << '\n';
+                abort();
+            }
+        } else if (arg_metrics_interval) {
+            arg_metrics_interval = false;
+            metrics_interval = atof(argv[i]);
+            if (metrics_interval <= 0.0)
+                metrics_interval = 10.0;
         }
     }
-    QuickSampler s(argv[argc-1], max_samples, max_time);
+    QuickSampler s(argv[argc-1], max_samples, max_time, jobs, flip_threads, pipelined, adaptive, budget_factor, backend, search_steps, binary, filter, preprocess, decompose, use_cache, dedup, dedup_memory, epoch_budget, epoch_memory, seed, quiet, metrics_destination, metrics_format, metrics_interval);
     s.run();
     return 0;
 }
@@ -0,0 +1,167 @@
+#ifndef QUICKSAMPLER_SAMPLE_H
+#define QUICKSAMPLER_SAMPLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// An assignment to the independent support, packed 64 variables per word.
+// Bits past size() in the last word are always zero, so whole words can be
+// compared and hashed directly.
+class Sample {
+    size_t nbits = 0;
+    std::vector<uint64_t> bits;
+
+public:
+    Sample() {}
+    explicit Sample(size_t n) : nbits(n), bits(words_for(n), 0) {}
+
+    static size_t words_for(size_t n) {
+        return (n + 63) / 64;
+    }
+
+    size_t size() const { return nbits; }
+    size_t nwords() const { return bits.size(); }
+    uint64_t * words() { return bits.data(); }
+    const uint64_t * words() const { return bits.data(); }
+
+    bool get(size_t i) const {
+        return (bits[i >> 6] >> (i & 63)) & 1;
+    }
+
+    void set(size_t i, bool b) {
+        uint64_t mask = (uint64_t)1 << (i & 63);
+        if (b)
+            bits[i >> 6] |= mask;
+        else
+            bits[i >> 6] &= ~mask;
+    }
+
+    void flip(size_t i) {
+        bits[i >> 6] ^= (uint64_t)1 << (i & 63);
+    }
+
+    bool operator==(const Sample & o) const {
+        return nbits == o.nbits && memcmp(bits.data(), o.bits.data(), bits.size() * sizeof(uint64_t)) == 0;
+    }
+
+    bool operator!=(const Sample & o) const {
+        return !(*this == o);
+    }
+
+    uint64_t hash() const {
+        uint64_t h = 0x9e3779b97f4a7c15ULL ^ nbits;
+        for (uint64_t w : bits) {
+            h ^= w;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 32;
+        }
+        return h;
+    }
+
+    // A 128-bit hash for deduplicating without keeping the samples: two
+    // independently seeded multiply-xorshift lanes, finished with the
+    // MurmurHash3 64-bit mixer.
+    void hash128(uint64_t & lo, uint64_t & hi) const {
+        uint64_t a = 0x243f6a8885a308d3ULL ^ nbits;
+        uint64_t b = 0x13198a2e03707344ULL + nbits;
+        for (uint64_t w : bits) {
+            a = (a ^ w) * 0x87c37b91114253d5ULL;
+            a ^= a >> 31;
+            b = (b + w) * 0x4cf5ad432745937fULL;
+            b ^= b >> 29;
+            a += b;
+        }
+        lo = fmix64(a);
+        hi = fmix64(b ^ lo);
+    }
+
+    std::string to_string() const {
+        std::string s(nbits, '0');
+        for (size_t i = 0; i < nbits; ++i)
+            if (get(i))
+                s[i] = '1';
+        return s;
+    }
+
+    static Sample from_string(const std::string & s) {
+        Sample r(s.size());
+        for (size_t i = 0; i < s.size(); ++i)
+            if (s[i] == '1')
+                r.set(i, true);
+        return r;
+    }
+
+    // out = a ^ ((a ^ b) | (a ^ c)): keep every bit of a that was flipped in
+    // either b or c. This is the combination step of QuickSampler.
+    static void combine(const Sample & a, const Sample & b, const Sample & c, Sample & out) {
+        if (out.nbits != a.nbits) {
+            out.nbits = a.nbits;
+            out.bits.resize(a.bits.size());
+        }
+        combine_words(a.words(), b.words(), c.words(), out.words(), a.nwords());
+    }
+
+    static void combine_words(const uint64_t * a, const uint64_t * b, const uint64_t * c, uint64_t * out, size_t n) {
+        switch (n) {
+        case 1: combine_fixed<1>(a, b, c, out); break;
+        case 2: combine_fixed<2>(a, b, c, out); break;
+        case 4: combine_fixed<4>(a, b, c, out); break;
+        case 8: combine_fixed<8>(a, b, c, out); break;
+        default: combine_any(a, b, c, out, n); break;
+        }
+    }
+
+private:
+    static uint64_t fmix64(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    template <size_t N>
+    static void combine_fixed(const uint64_t * a, const uint64_t * b, const uint64_t * c, uint64_t * out) {
+        for (size_t i = 0; i < N; ++i)
+            out[i] = a[i] ^ ((a[i] ^ b[i]) | (a[i] ^ c[i]));
+    }
+
+    static void combine_any(const uint64_t * a, const uint64_t * b, const uint64_t * c, uint64_t * out, size_t n) {
+        size_t i = 0;
+#if defined(__AVX512F__)
+        for (; i + 8 <= n; i += 8) {
+            __m512i va = _mm512_loadu_si512((const void *)(a + i));
+            __m512i vb = _mm512_loadu_si512((const void *)(b + i));
+            __m512i vc = _mm512_loadu_si512((const void *)(c + i));
+            __m512i d = _mm512_or_si512(_mm512_xor_si512(va, vb), _mm512_xor_si512(va, vc));
+            _mm512_storeu_si512((void *)(out + i), _mm512_xor_si512(va, d));
+        }
+#endif
+#if defined(__AVX2__)
+        for (; i + 4 <= n; i += 4) {
+            __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+            __m256i vc = _mm256_loadu_si256((const __m256i *)(c + i));
+            __m256i d = _mm256_or_si256(_mm256_xor_si256(va, vb), _mm256_xor_si256(va, vc));
+            _mm256_storeu_si256((__m256i *)(out + i), _mm256_xor_si256(va, d));
+        }
+#endif
+        for (; i < n; ++i)
+            out[i] = a[i] ^ ((a[i] ^ b[i]) | (a[i] ^ c[i]));
+    }
+};
+
+struct SampleHash {
+    size_t operator()(const Sample & s) const {
+        return (size_t)s.hash();
+    }
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef QUICKSAMPLER_SCHEDULER_H
+#define QUICKSAMPLER_SCHEDULER_H
+
+#include <stdint.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Chooses which variables to flip in an epoch, and in what order, from what
+// their flips did in earlier epochs of every worker: how often a flip was
+// satisfiable, how long it took, and how many new samples it led to, its
+// own model and the combinations made when it arrived. A variable's score is
+// its smoothed yield per flip divided by its mean solver time, an estimate
+// of new samples per second. Variables are flipped best first; those scoring
+// under skip_ratio times the median are skipped, except with probability
+// explore, and every variable is flipped min_flips times before it can be.
+class FlipScheduler {
+    struct Stats {
+        std::atomic<uint64_t> flips{0};
+        std::atomic<uint64_t> sat{0};
+        std::atomic<uint64_t> yield{0};
+        std::atomic<uint64_t> ticks{0};
+    };
+    std::vector<Stats> stats;
+    std::atomic<uint64_t> planned{0};
+    std::atomic<uint64_t> skipped{0};
+
+public:
+    enum { min_flips = 2 };
+    static constexpr double skip_ratio = 0.25;
+    static constexpr double explore = 0.1;
+
+    explicit FlipScheduler(size_t nvars) : stats(nvars) {}
+
+    void record(size_t var, bool sat, uint64_t ticks) {
+        Stats & s = stats[var];
+        s.flips.fetch_add(1, std::memory_order_relaxed);
+        if (sat)
+            s.sat.fetch_add(1, std::memory_order_relaxed);
+        s.ticks.fetch_add(ticks, std::memory_order_relaxed);
+    }
+
+    // A new sample that the flip of var led to.
+    void credit(size_t var) {
+        stats[var].yield.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Writes the indices into positions of the variables to flip this epoch,
+    // best first. Variables in skip are left out.
+    template <typename Skip>
+    void plan(const std::vector<size_t> & positions, Skip skip, std::mt19937 & rng, std::vector<size_t> & order) {
+        std::vector<std::pair<double, size_t>> ranked;
+        std::vector<double> scores;
+        for (size_t i = 0; i < positions.size(); ++i) {
+            if (skip(positions[i]))
+                continue;
+            double s = score(positions[i]);
+            ranked.emplace_back(s, i);
+            if (s < HUGE_VAL)
+                scores.push_back(s);
+        }
+        double threshold = 0;
+        if (!scores.empty()) {
+            std::nth_element(scores.begin(), scores.begin() + scores.size() / 2, scores.end());
+            threshold = skip_ratio * scores[scores.size() / 2];
+        }
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        order.clear();
+        std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<double, size_t> & a, const std::pair<double, size_t> & b) {
+            return a.first > b.first;
+        });
+        for (const auto & r : ranked) {
+            if (r.first < threshold && coin(rng) >= explore) {
+                skipped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            order.push_back(r.second);
+        }
+        planned.fetch_add(ranked.size(), std::memory_order_relaxed);
+    }
+
+    // Prints the totals and the variables with the highest and lowest
+    // scores among those flipped, all of them if there are few. Variables
+    // flipped fewer than min_flips times come last, without a score.
+    void print(const std::vector<int> & ind, double ticks_per_second) const {
+        printf("Flips planned %llu, skipped %llu\n", (unsigned long long)planned.load(), (unsigned long long)skipped.load());
+        std::vector<std::pair<double, size_t>> ranked;
+        for (size_t v = 0; v < stats.size(); ++v)
+            if (stats[v].flips > 0)
+                ranked.emplace_back(stats[v].flips < min_flips ? -1.0 : score(v), v);
+        std::sort(ranked.begin(), ranked.end(), [](const std::pair<double, size_t> & a, const std::pair<double, size_t> & b) {
+            return a.first > b.first;
+        });
+        const size_t shown = 10;
+        printf("%-10s %8s %8s %8s %10s %12s\n", "Variable", "flips", "sat %", "yield", "mean ms", "score");
+        for (size_t k = 0; k < ranked.size(); ++k) {
+            if (k == shown && ranked.size() > 2 * shown) {
+                printf("%-10s\n", "...");
+                k = ranked.size() - shown;
+            }
+            const Stats & s = stats[ranked[k].second];
+            uint64_t n = s.flips;
+            printf("%-10d %8llu %8.1f %8llu %10.3f ", ind[ranked[k].second], (unsigned long long)n, 100.0 * s.sat / n,
+                   (unsigned long long)s.yield.load(), 1000.0 * s.ticks / n / ticks_per_second);
+            if (ranked[k].first < 0)
+                printf("%12s\n", "-");
+            else
+                printf("%12.1f\n", ranked[k].first * ticks_per_second);
+        }
+        fflush(stdout);
+    }
+
+private:
+    // New samples per tick of solver time; infinite until min_flips.
+    double score(size_t var) const {
+        const Stats & s = stats[var];
+        uint64_t n = s.flips.load(std::memory_order_relaxed);
+        if (n < min_flips)
+            return HUGE_VAL;
+        double yield = (s.yield.load(std::memory_order_relaxed) + 1.0) / (n + 2.0);
+        double ticks = (double)s.ticks.load(std::memory_order_relaxed) / n + 1.0;
+        return yield / ticks;
+    }
+};
+
+#endif
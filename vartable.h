@@ -0,0 +1,84 @@
+#ifndef QUICKSAMPLER_VARTABLE_H
+#define QUICKSAMPLER_VARTABLE_H
+
+#include <z3++.h>
+#include <string>
+#include <vector>
+
+#include "sample.h"
+
+// Boolean constants of one z3::context, created once and indexed by DIMACS
+// variable id, plus the declarations of the independent support in sample
+// order for reading models back.
+class VarTable {
+    z3::context & c;
+    std::vector<z3::expr> pos;
+    std::vector<z3::expr> neg;
+    std::vector<z3::expr> ind_pos;
+    std::vector<z3::expr> ind_neg;
+    std::vector<z3::func_decl> ind_decls;
+
+public:
+    VarTable(z3::context & c) : c(c) {}
+
+    void init(int max_var, const std::vector<int> & ind) {
+        int nvars = max_var;
+        for (int v : ind)
+            if (v > nvars)
+                nvars = v;
+        pos.clear();
+        neg.clear();
+        pos.reserve(nvars + 1);
+        neg.reserve(nvars + 1);
+        for (int v = 0; v <= nvars; ++v) {
+            pos.push_back(make(v));
+            neg.push_back(!pos.back());
+        }
+        ind_pos.clear();
+        ind_neg.clear();
+        ind_decls.clear();
+        for (int v : ind) {
+            ind_pos.push_back(var(v));
+            ind_neg.push_back(!ind_pos.back());
+            ind_decls.push_back(ind_pos.back().decl());
+        }
+    }
+
+    z3::expr var(int v) const {
+        if (v >= 0 && v < (int)pos.size())
+            return pos[v];
+        return make(v);
+    }
+
+    // The literal setting the i-th independent variable to value.
+    const z3::expr & ind_lit(size_t i, bool value) const {
+        return value ? ind_pos[i] : ind_neg[i];
+    }
+
+    // The expression for a signed DIMACS literal.
+    Z3_ast dimacs(int l) const {
+        return l > 0 ? (Z3_ast)pos[l] : (Z3_ast)neg[-l];
+    }
+
+    // Writes the value of every independent variable in m into s. Variables
+    // without an interpretation read as false.
+    void extract(const z3::model & m, Sample & s) const {
+        if (s.size() != ind_decls.size())
+            s = Sample(ind_decls.size());
+        uint64_t * w = s.words();
+        for (size_t k = 0; k < s.nwords(); ++k)
+            w[k] = 0;
+        for (size_t i = 0; i < ind_decls.size(); ++i) {
+            Z3_ast b = Z3_model_get_const_interp(c, m, ind_decls[i]);
+            if (b && Z3_get_bool_value(c, b) == Z3_L_TRUE)
+                w[i >> 6] |= (uint64_t)1 << (i & 63);
+        }
+    }
+
+private:
+    z3::expr make(int v) const {
+        return c.constant(c.str_symbol(std::to_string(v).c_str()), c.bool_sort());
+    }
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef QUICKSAMPLER_WRITER_H
+#define QUICKSAMPLER_WRITER_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <string>
+#include <vector>
+
+#include "sample.h"
+
+// Samples are written either as text lines "nmut: 0101..." or in a binary
+// format: a header followed by fixed-width records.
+//
+// Header, all fields little-endian:
+//     char     magic[4]      "QSMP"
+//     uint32_t version       1
+//     uint32_t nvars         size of the independent support
+//     uint32_t record_size   1 + (nvars + 7) / 8
+//     int32_t  ind[nvars]    the "c ind" ordering of the variables
+// Record:
+//     uint8_t  nmut          number of mutations
+//     uint8_t  bits[]        variable i is bit i % 8 of bits[i / 8]
+namespace sample_format {
+
+const char magic[4] = {'Q', 'S', 'M', 'P'};
+const uint32_t version = 1;
+
+inline size_t record_size(size_t nvars) {
+    return 1 + (nvars + 7) / 8;
+}
+
+inline void put_u32(std::string & out, uint32_t v) {
+    for (int k = 0; k < 4; ++k)
+        out += (char)((v >> (8 * k)) & 0xff);
+}
+
+inline uint32_t get_u32(const unsigned char * p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline std::string header(const std::vector<int> & ind) {
+    std::string out(magic, 4);
+    put_u32(out, version);
+    put_u32(out, ind.size());
+    put_u32(out, record_size(ind.size()));
+    for (int v : ind)
+        put_u32(out, (uint32_t)v);
+    return out;
+}
+
+inline void append_text(std::string & out, const Sample & s, int nmut) {
+    out += std::to_string(nmut);
+    out += ": ";
+    size_t pos = out.size();
+    out.resize(pos + s.size() + 1, '0');
+    char * p = &out[pos];
+    const uint64_t * w = s.words();
+    for (size_t i = 0; i < s.size(); ++i)
+        if ((w[i >> 6] >> (i & 63)) & 1)
+            p[i] = '1';
+    p[s.size()] = '\n';
+}
+
+inline void append_binary(std::string & out, const Sample & s, int nmut) {
+    size_t pos = out.size();
+    size_t nbytes = (s.size() + 7) / 8;
+    out.resize(pos + 1 + nbytes);
+    unsigned char * p = (unsigned char *)&out[pos];
+    p[0] = (unsigned char)nmut;
+    const uint64_t * w = s.words();
+    for (size_t b = 0; b < nbytes; ++b)
+        p[1 + b] = (unsigned char)(w[b >> 3] >> (8 * (b & 7)));
+}
+
+inline void read_binary(const unsigned char * record, Sample & s, int & nmut) {
+    nmut = record[0];
+    uint64_t * w = s.words();
+    for (size_t k = 0; k < s.nwords(); ++k)
+        w[k] = 0;
+    size_t nbytes = (s.size() + 7) / 8;
+    for (size_t b = 0; b < nbytes; ++b)
+        w[b >> 3] |= (uint64_t)record[1 + b] << (8 * (b & 7));
+}
+
+}
+
+// Appends to a file through one large page-aligned buffer. Blocks larger
+// than the free space are written together with the buffer using writev.
+// The first write error is kept, and nothing is written after it, so the
+// caller can tell a truncated file from a complete one. Not thread-safe;
+// callers serialize access.
+class BufferedWriter {
+    int fd = -1;
+    char * buf = nullptr;
+    size_t capacity;
+    size_t used = 0;
+    int error_code = 0;
+
+public:
+    explicit BufferedWriter(size_t capacity = 4 << 20) : capacity(capacity) {}
+
+    ~BufferedWriter() {
+        close();
+        free(buf);
+    }
+
+    bool open(const std::string & path) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        if (!buf && posix_memalign((void **)&buf, 4096, capacity) != 0) {
+            buf = nullptr;
+            return false;
+        }
+        used = 0;
+        error_code = 0;
+        return true;
+    }
+
+    bool is_open() const {
+        return fd >= 0;
+    }
+
+    // The errno of the first failed write or close; 0 if there was none.
+    int error() const {
+        return error_code;
+    }
+
+    void write(const char * data, size_t n) {
+        if (used + n <= capacity) {
+            memcpy(buf + used, data, n);
+            used += n;
+            return;
+        }
+        struct iovec iov[2];
+        iov[0].iov_base = buf;
+        iov[0].iov_len = used;
+        iov[1].iov_base = (void *)data;
+        iov[1].iov_len = n;
+        write_all(iov, 2);
+        used = 0;
+    }
+
+    void write(const std::string & s) {
+        write(s.data(), s.size());
+    }
+
+    void flush() {
+        if (used == 0)
+            return;
+        struct iovec iov[1];
+        iov[0].iov_base = buf;
+        iov[0].iov_len = used;
+        write_all(iov, 1);
+        used = 0;
+    }
+
+    void close() {
+        if (fd < 0)
+            return;
+        flush();
+        if (::close(fd) != 0 && error_code == 0)
+            error_code = errno;
+        fd = -1;
+    }
+
+private:
+    void write_all(struct iovec * iov, int n) {
+        while (n > 0 && error_code == 0) {
+            ssize_t w = writev(fd, iov, n);
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                error_code = errno;
+                return;
+            }
+            while (n > 0 && (size_t)w >= iov->iov_len) {
+                w -= iov->iov_len;
+                ++iov;
+                --n;
+            }
+            if (n > 0) {
+                iov->iov_base = (char *)iov->iov_base + w;
+                iov->iov_len -= w;
+            }
+        }
+    }
+};
+
+#endif